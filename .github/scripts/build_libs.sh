@@ -9,4 +9,6 @@ CFLAGS="-fsanitize=address -g3" make EXE=libchessutil_asan.a
 make clean
 CFLAGS="-fsanitize=undefined -g3" make EXE=libchessutil_ubsan.a
 make clean
+CFLAGS="-mbmi2 -DCU_USE_PEXT -fsanitize=address -g3" make EXE=libchessutil_pext_asan.a
+make clean
 AR=gcc-ar CFLAGS="-flto" make EXE=libchessutil_lto.a
\ No newline at end of file
@@ -12,15 +12,19 @@ name=""
 case $1 in
     --asan)
         echo "Running tests under AddressSanitizer..."
-        gcc -g3 -fsanitize=address -I include -o perft_check test/perft_check.c libchessutil_asan.a || exit 1 ;;
+        gcc -g3 -fsanitize=address -I include -o perft_check test/perft_check.c libchessutil_asan.a -pthread || exit 1 ;;
 
     --ubsan)
         echo "Running tests under UndefinedBehaviorSanitizer..."
-        gcc -g3 -fsanitize=undefined -I include -o perft_check test/perft_check.c libchessutil_ubsan.a || exit 1 ;;
+        gcc -g3 -fsanitize=undefined -I include -o perft_check test/perft_check.c libchessutil_ubsan.a -pthread || exit 1 ;;
+
+    --pext)
+        echo "Running tests with the PEXT backend under AddressSanitizer..."
+        gcc -g3 -mbmi2 -DCU_USE_PEXT -fsanitize=address -I include -o perft_check test/perft_check.c libchessutil_pext_asan.a -pthread || exit 1 ;;
 
     --bench)
         echo "Running benchmark tests..."
-        gcc -O3 -flto -I include -o perft_check test/perft_check.c libchessutil_lto.a || exit 1 ;;
+        gcc -O3 -flto -I include -o perft_check test/perft_check.c libchessutil_lto.a -pthread || exit 1 ;;
 
     *)
         exit 1 ;;
@@ -60,10 +60,48 @@
 
 #endif // CU_USE_BUILTINS
 
+// Use the BMI2 'pext' instruction for indexing the slider attack tables instead
+// of fancy magics. This is generally faster on CPUs with a fast 'pext'
+// implementation (Intel Haswell and later, AMD Zen 3 and later).
+// Note: the define must be set both when building the library and when
+// including this header, by adding "-DCU_USE_PEXT -mbmi2" to the CFLAGS
+// variable (or by using the 'pext' Makefile target for the library).
+#ifdef CU_USE_PEXT
+#ifndef __BMI2__
+#error "CU_USE_PEXT requires BMI2 support, add -mbmi2 or a suitable -march to the CFLAGS variable"
+#endif
+#include <immintrin.h>
+#endif
+
+// Build all the lookup tables of the library at compile time instead of
+// computing them in cu_init(). The tables are then stored in read-only memory.
+// Note: this is enabled by building the library with "static_tables=yes" (see
+// the 'tables' Makefile target). Code including this header only needs to add
+// "-DCU_STATIC_TABLES" to the CFLAGS variable for const-correct declarations.
+#ifdef CU_STATIC_TABLES
+#define __CU_TABLE const
+#else
+#define __CU_TABLE
+#endif
+
 #define __CU_INLINE static inline
 
 #define CU_MAX_MOVES 512
 
+// Size of a buffer large enough for any FEN written by the library, including
+// the null terminator.
+#define CU_FEN_MAX_LENGTH 128
+
+// Size of a buffer large enough for any SAN move written by the library,
+// including the null terminator.
+#define CU_SAN_MAX_LENGTH 8
+
+// Sizes of the key history used by boards for repetition detection. The
+// history size must be a power of two.
+#define CU_KEY_HISTORY_SIZE 256
+#define CU_KEY_FILTER_BITS 10
+#define CU_KEY_FILTER_SIZE (1 << CU_KEY_FILTER_BITS)
+
 __CU_BEGIN_DECLS
 
 // Returns the version string of the library.
@@ -184,7 +222,7 @@ enum direction_e {
 };
 
 // Internal table for square_distance() function.
-extern uint8_t __cu_square_distance[SQUARE_NB][SQUARE_NB];
+extern __CU_TABLE uint8_t __cu_square_distance[SQUARE_NB][SQUARE_NB];
 
 // Creates a square given the file and the rank.
 __CU_INLINE square_t create_square(file_t f, rank_t r) {
@@ -369,25 +407,30 @@ typedef uint64_t bitboard_t;
 #define DARK_SQUARES_BB  UINT64_C(0xAA55AA55AA55AA55)
 #define ALL_SQUARES_BB   UINT64_C(0xFFFFFFFFFFFFFFFF)
 
-// Data structure used in fancy magic bitboards.
+// Data structure used in fancy magic bitboards. (When using PEXT indexing, the
+// magic and shift fields are unused.)
 typedef struct cu_magic_s {
     bitboard_t mask;
     bitboard_t magic;
-    bitboard_t *moves;
+    const bitboard_t *moves;
     unsigned int shift;
 } cu_magic_t;
 
 // Internal tables for bitboard operations like pseudo-move generation and
 // square alignment checks.
-extern bitboard_t __cu_line_bb[SQUARE_NB][SQUARE_NB];
-extern bitboard_t __cu_pseudo_moves_bb[PIECETYPE_NB][SQUARE_NB];
-extern bitboard_t __cu_pawn_moves_bb[COLOR_NB][SQUARE_NB];
-extern cu_magic_t __cu_rook_magics[SQUARE_NB];
-extern cu_magic_t __cu_bishop_magics[SQUARE_NB];
+extern __CU_TABLE bitboard_t __cu_line_bb[SQUARE_NB][SQUARE_NB];
+extern __CU_TABLE bitboard_t __cu_pseudo_moves_bb[PIECETYPE_NB][SQUARE_NB];
+extern __CU_TABLE bitboard_t __cu_pawn_moves_bb[COLOR_NB][SQUARE_NB];
+extern __CU_TABLE cu_magic_t __cu_rook_magics[SQUARE_NB];
+extern __CU_TABLE cu_magic_t __cu_bishop_magics[SQUARE_NB];
 
 // Returns the index of the attack bitboard for the given magic and occupancy.
 __CU_INLINE unsigned int magic_index(const cu_magic_t *magic, bitboard_t occupancy) {
+#ifdef CU_USE_PEXT
+    return (unsigned int)_pext_u64(occupancy, magic->mask);
+#else
     return (unsigned int)(((occupancy & magic->mask) * magic->magic) >> magic->shift);
+#endif
 }
 
 // Returns the bitboard representation of the square.
@@ -674,10 +717,10 @@ __CU_INLINE uint64_t cu_xorshift(uint64_t *state) {
 typedef uint64_t hashkey_t;
 
 // Internal tables for Zobrist hashing.
-extern hashkey_t __cu_zobrist_psq[PIECE_NB][SQUARE_NB];
-extern hashkey_t __cu_zobrist_ep[FILE_NB];
-extern hashkey_t __cu_zobrist_castling[CASTLING_NB];
-extern hashkey_t __cu_zobrist_turn;
+extern __CU_TABLE hashkey_t __cu_zobrist_psq[PIECE_NB][SQUARE_NB];
+extern __CU_TABLE hashkey_t __cu_zobrist_ep[FILE_NB];
+extern __CU_TABLE hashkey_t __cu_zobrist_castling[CASTLING_NB];
+extern __CU_TABLE hashkey_t __cu_zobrist_turn;
 
 // Enum for game outcomes.
 typedef enum outcome_e {
@@ -692,8 +735,12 @@ typedef struct Boardstack_ {
     struct Boardstack_ *prev;
     hashkey_t key;
     hashkey_t materialKey;
+    // Key of the position with the random numbers of the Polyglot standard.
+    hashkey_t polyglotKey;
     int rule50;
     int lastNullmove;
+    // Number of earlier occurrences of the position since the last
+    // irreversible move or null move.
     int repetition;
     move_t lastMove;
     square_t enPassantSq;
@@ -701,11 +748,34 @@ typedef struct Boardstack_ {
     castling_t castlingRights;
     piece_t capturedPiece;
     bitboard_t checkers;
+    // The fields below are only computed on first access through the
+    // board_check_*() accessors. checkInfo holds the CHECKINFO_* flags of the
+    // fields which are up to date.
+    int checkInfo;
     bitboard_t checkBlockers[COLOR_NB];
     bitboard_t checkPinners[COLOR_NB];
     bitboard_t checkSquares[PIECETYPE_NB];
 } Boardstack;
 
+// Flags for the lazily computed check information of a stack.
+enum {
+    CHECKINFO_WHITE_BLOCKERS = 1,
+    CHECKINFO_BLACK_BLOCKERS = 2,
+    CHECKINFO_SQUARES = 4
+};
+
+// Structure for a block of stacks used by the internal stack allocator of a
+// board. Stacks are taken from and given back to the blocks in LIFO order,
+// and the blocks are only freed when the board is destroyed.
+typedef struct BoardstackBlock_ {
+    struct BoardstackBlock_ *prev;
+    struct BoardstackBlock_ *next;
+    Boardstack *stacks;
+    size_t size;
+    size_t used;
+    bool external;
+} BoardstackBlock;
+
 // Structure for the board
 typedef struct Board_ {
     piece_t table[SQUARE_NB];
@@ -719,8 +789,17 @@ typedef struct Board_ {
     int gamePly;
     color_t sideToMove;
     Boardstack *stack;
+    BoardstackBlock *stackBlock;
     bool chess960;
     bool internalStackAllocator;
+    // Keys of the last positions of the board, indexed by the number of plies
+    // since the root, with the ply each slot was written at, and a counting
+    // filter over the high bits of all keys in the history, used to skip the
+    // search for repetitions.
+    int historyPly;
+    hashkey_t keyHistory[CU_KEY_HISTORY_SIZE];
+    int keyHistoryPly[CU_KEY_HISTORY_SIZE];
+    uint16_t keyFilter[CU_KEY_FILTER_SIZE];
 } Board;
 
 // Constant for the starting board.
@@ -739,10 +818,19 @@ int board_from_fen(Board *board, Boardstack *stack, const char *fen);
 // they have been allocated internally, and frees the error string, if any.
 void board_destroy(Board *board);
 
-// Resets the board to its initial state. Will free all stacks from the board
-// if they have been allocated internally (except for the first one).
+// Resets the board to its initial state. Stacks allocated internally are given
+// back to the board's allocator, and kept for reuse until board_destroy().
 void board_reset(Board *board);
 
+// Makes the board take the stacks of all subsequent pushes from the given
+// buffer of stacks, in LIFO order, instead of the stacks passed to board_push()
+// and board_push_nullmove(). If the buffer gets full, additional stacks are
+// allocated internally. The buffer must stay valid until board_destroy(), and
+// a board can only be given one buffer. If any error arises, it will be stored
+// in the board.
+// Returns 0 if successful, a non-null value otherwise.
+int board_use_stack_buffer(Board *board, Boardstack *buffer, size_t size);
+
 // Returns the error string, if any.
 __CU_INLINE const char *board_get_error(Board *board) {
     return board->err[0] ? board->err : NULL;
@@ -764,6 +852,17 @@ int board_copy_root(Board *dst, const Board *src, Boardstack *stack);
 // Returns 0 if successful, a non-null value otherwise.
 int board_copy(Board *dst, const Board *src);
 
+// Copies the source board to the destination board without copying its
+// stacks: the destination shares the history of the source, and allocates the
+// stacks of its own pushes internally. The source must stay valid, and must
+// not pop any of the shared stacks, as long as the destination is in use.
+// The lazy check info of the current stack is filled before sharing it, so
+// that the source and the destination can be used from different threads.
+// The copy itself must not run concurrently with other uses of the source.
+// Popping the destination below the copied position fills the check info of
+// older shared stacks, so at most one board may do so at a time.
+void board_copy_shallow(Board *dst, const Board *src);
+
 // Returns the piece at the given square.
 __CU_INLINE piece_t board_piece_at(const Board *board, square_t sq) {
     return board->table[sq];
@@ -803,6 +902,43 @@ __CU_INLINE bitboard_t board_checkers(const Board *board) {
     return board->stack->checkers;
 }
 
+// Computes the blockers of the King of the given color, and the pinners of the
+// other color, for the current stack.
+void __board_compute_blockers(const Board *board, color_t c);
+
+// Computes the squares from which each piecetype would check the opponent King
+// for the current stack.
+void __board_compute_check_squares(const Board *board);
+
+// Returns the bitboard of pieces (of both colors) blocking a slider attack on
+// the King of the given color.
+__CU_INLINE bitboard_t board_check_blockers(const Board *board, color_t c) {
+    if (!(board->stack->checkInfo & (CHECKINFO_WHITE_BLOCKERS << c)))
+        __board_compute_blockers(board, c);
+
+    return board->stack->checkBlockers[c];
+}
+
+// Returns the bitboard of sliders of the given color pinning a piece to the
+// opponent King.
+__CU_INLINE bitboard_t board_check_pinners(const Board *board, color_t c) {
+    color_t them = flip_color(c);
+
+    if (!(board->stack->checkInfo & (CHECKINFO_WHITE_BLOCKERS << them)))
+        __board_compute_blockers(board, them);
+
+    return board->stack->checkPinners[c];
+}
+
+// Returns the bitboard of squares from which a piece of the given piecetype of
+// the side to move would give check.
+__CU_INLINE bitboard_t board_check_squares(const Board *board, piecetype_t pt) {
+    if (!(board->stack->checkInfo & CHECKINFO_SQUARES))
+        __board_compute_check_squares(board);
+
+    return board->stack->checkSquares[pt];
+}
+
 // Tests if the side to move is in check.
 __CU_INLINE bool board_is_in_check(const Board *board) {
     return !!board_checkers(board);
@@ -864,6 +1000,13 @@ __CU_INLINE hashkey_t board_key(const Board *board) {
     return board->stack->key;
 }
 
+// Returns the Polyglot key of the board, for probing opening books. The
+// en-passant file is only part of the key if a Pawn of the side to move
+// attacks the en-passant square.
+__CU_INLINE hashkey_t board_polyglot_key(const Board *board) {
+    return board->stack->polyglotKey;
+}
+
 // Returns the material key of the board.
 __CU_INLINE hashkey_t board_material_key(const Board *board) {
     return board->stack->materialKey;
@@ -891,6 +1034,10 @@ bool board_move_is_legal(const Board *board, move_t move);
 // least pseudo-legal.
 bool board_move_gives_check(const Board *board, move_t move);
 
+// Returns the Zobrist key the board would have after the given move, without
+// playing it. The move must be at least pseudo-legal.
+hashkey_t board_key_after(const Board *board, move_t move);
+
 // Tests if the side to move is checkmated.
 bool board_is_checkmate(const Board *board);
 
@@ -911,7 +1058,7 @@ bool board_is_rule50_draw(const Board *board);
 
 // Tests if the game is drawn by fivefold repetition.
 __CU_INLINE bool board_is_fivefold_draw(const Board *board) {
-    return board->stack->repetition >= 5;
+    return board->stack->repetition >= 4;
 }
 
 // Tests if the game can be drawn by threefold repetition.
@@ -919,7 +1066,7 @@ __CU_INLINE bool board_is_fivefold_draw(const Board *board) {
 // and then claim the draw, this might be added as a second parameter in the
 // future.)
 __CU_INLINE bool board_is_threefold_draw(const Board *board) {
-    return board->stack->repetition >= 3;
+    return board->stack->repetition >= 2;
 }
 
 // Returns the outcome of the board, or NO_OUTCOME if the game should continue.
@@ -957,6 +1104,30 @@ move_t *board_peek_all_moves(Board *board);
 // before successive calls if you need it for a longer time.
 const char *board_to_fen(const Board *board);
 
+// Writes the null-terminated FEN representation of the position to the given
+// buffer of len bytes. A buffer of CU_FEN_MAX_LENGTH bytes is always large
+// enough. Returns the length of the FEN, or 0 if it doesn't fit in the buffer.
+size_t board_write_fen(const Board *board, char *buf, size_t len);
+
+// Writes the FEN representations of the given boards to the given buffer of len
+// bytes, each one followed by a newline, and null-terminates the result.
+// Stops at the first FEN which doesn't fit in the buffer. Stores the number of
+// written bytes in length, and returns the number of written FENs.
+size_t board_write_fen_batch(const Board *boards, size_t count, char *buf, size_t len, size_t *length);
+
+// Writes the null-terminated SAN representation of the given legal move to
+// the given buffer of len bytes. A buffer of CU_SAN_MAX_LENGTH bytes is always
+// large enough. The move is temporarily pushed on the board to detect mates.
+// Returns the length of the SAN, or 0 if it doesn't fit in the buffer or if an
+// error occured.
+size_t board_move_to_san(Board *board, move_t move, char *buf, size_t len);
+
+// Parses the given SAN move, which may be followed by check and annotation
+// suffixes, whitespace or the end of the string. Capture markers and suffixes
+// are not verified. Returns the corresponding legal move, or NO_MOVE if the
+// SAN is invalid, illegal or ambiguous.
+move_t board_san_to_move(const Board *board, const char *san);
+
 // Checks if the given pseudo-legal move is a capture.
 __CU_INLINE bool board_is_capture(const Board *board, move_t move) {
     return move_type(move) == EN_PASSANT
@@ -987,11 +1158,29 @@ bool board_is_attacked_by(const Board *board, square_t sq, color_t c);
 // Pinned pieces still count as attackers.
 bitboard_t board_attackers(const Board *board, square_t sq, color_t c);
 
+// Enum for the piece values used by the static exchange evaluation.
+enum see_value_e {
+    SEE_PAWN_VALUE = 100, SEE_KNIGHT_VALUE = 300, SEE_BISHOP_VALUE = 300,
+    SEE_ROOK_VALUE = 500, SEE_QUEEN_VALUE = 900
+};
+
+// Returns the static exchange evaluation of the given pseudo-legal move, that
+// is the material balance of the best capture sequence on its destination
+// square. Sliders behind the capturing pieces join the exchange, and pinned
+// pieces are ignored while their pinner is still on the board. Castling moves
+// have a value of zero.
+int board_see(const Board *board, move_t move);
+
+// Tests if the static exchange evaluation of the given pseudo-legal move is
+// greater than or equal to the threshold. This is faster than board_see(), as
+// the exchange is stopped as soon as its outcome is known.
+bool board_see_ge(const Board *board, move_t move, int threshold);
+
 // Checks if the given square is pinned to the King of the given color.
 // There must be a piece of the same color as the King on the square for the
 // test to be valid.
 __CU_INLINE bool board_is_pinned(const Board *board, square_t sq, color_t c) {
-    return !!(board->stack->checkBlockers[c] & square_bb(sq));
+    return !!(board_check_blockers(board, c) & square_bb(sq));
 }
 
 // Checks if the given castling is blocked by pieces obstructing the path.
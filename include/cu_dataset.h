@@ -0,0 +1,153 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __CU_DATASET_H__
+#define __CU_DATASET_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include "cu_core.h"
+#include "cu_pack.h"
+
+__CU_BEGIN_DECLS
+
+// A dataset file is made of a header of CU_DATASET_HEADER_SIZE bytes,
+// followed by fixed-size records. All multi-byte fields are stored in
+// little-endian order.
+//  - header bytes 0-7: the magic string CU_DATASET_MAGIC;
+//  - header bytes 8-11: the format version;
+//  - header bytes 12-15: the size of a record;
+//  - header bytes 16-23: the number of records;
+//  - header bytes 24-27: the DATASET_* flags of the file;
+//  - other header bytes: zero.
+// A record holds a packed position, followed by a payload if the file has the
+// DATASET_PAYLOAD flag:
+//  - payload bytes 0-1: the score, as a signed integer;
+//  - payload byte 2: the outcome_t of the game;
+//  - payload bytes 4-5: the best move;
+//  - other payload bytes: zero.
+
+#define CU_DATASET_MAGIC "CUDSET\r\n"
+#define CU_DATASET_VERSION 1
+#define CU_DATASET_HEADER_SIZE 64
+#define CU_DATASET_PAYLOAD_SIZE 8
+
+// Enum for the flags of a dataset file.
+enum {
+    DATASET_PAYLOAD = 1
+};
+
+// Structure for a record of a dataset file. The payload is only present if
+// the file has the DATASET_PAYLOAD flag.
+typedef struct DatasetRecord_ {
+    PackedBoard position;
+    uint8_t payload[CU_DATASET_PAYLOAD_SIZE];
+} DatasetRecord;
+
+// Structure for writing a dataset file.
+typedef struct DatasetWriter_ {
+    FILE *file;
+    uint64_t count;
+    int flags;
+    char err[128];
+} DatasetWriter;
+
+// Structure for a memory-mapped dataset file.
+typedef struct Dataset_ {
+    const uint8_t *data;
+    size_t size;
+    uint64_t count;
+    size_t recordSize;
+    int flags;
+    char err[128];
+} Dataset;
+
+// Structure for iterating over a range of records of a dataset.
+typedef struct DatasetIterator_ {
+    const Dataset *dataset;
+    uint64_t index;
+    uint64_t end;
+} DatasetIterator;
+
+// Creates the dataset file at the given path, with the given DATASET_* flags.
+// If any error arises, it will be stored in the writer.
+// Returns 0 if successful, a non-null value otherwise.
+int dataset_writer_open(DatasetWriter *writer, const char *path, int flags);
+
+// Appends the current position of the board to the dataset file. The score,
+// outcome and best move are ignored if the file has no payload.
+// Returns 0 if successful, a non-null value otherwise.
+int dataset_write(DatasetWriter *writer, const Board *board, int score, outcome_t outcome, move_t bestMove);
+
+// Writes the final header and closes the dataset file. Closing a writer that
+// failed to open does nothing and returns an error.
+// Returns 0 if successful, a non-null value otherwise.
+int dataset_writer_close(DatasetWriter *writer);
+
+// Memory-maps the dataset file at the given path, and checks its header. If
+// any error arises, it will be stored in the dataset.
+// Returns 0 if successful, a non-null value otherwise.
+int dataset_open(Dataset *dataset, const char *path);
+
+// Unmaps the dataset file.
+void dataset_close(Dataset *dataset);
+
+// Returns the number of records of the dataset.
+__CU_INLINE uint64_t dataset_size(const Dataset *dataset) {
+    return dataset->count;
+}
+
+// Returns the record of the given index, which must be lower than the number
+// of records. The record points into the mapping of the file.
+__CU_INLINE const DatasetRecord *dataset_record(const Dataset *dataset, uint64_t index) {
+    return (const DatasetRecord *)(dataset->data + CU_DATASET_HEADER_SIZE + index * dataset->recordSize);
+}
+
+// Initializes the board from the position of the record.
+// If stack is NULL, all the stacks will be allocated internally.
+// Returns 0 if successful, a non-null value otherwise.
+__CU_INLINE int dataset_record_board(Board *board, Boardstack *stack, const DatasetRecord *record) {
+    return board_unpack(board, stack, &record->position);
+}
+
+// Returns the score of the record. The dataset must have a payload.
+__CU_INLINE int dataset_record_score(const DatasetRecord *record) {
+    return (int16_t)(record->payload[0] | (record->payload[1] << 8));
+}
+
+// Returns the outcome of the record. The dataset must have a payload.
+__CU_INLINE outcome_t dataset_record_outcome(const DatasetRecord *record) {
+    return (outcome_t)record->payload[2];
+}
+
+// Returns the best move of the record. The dataset must have a payload.
+__CU_INLINE move_t dataset_record_move(const DatasetRecord *record) {
+    return (move_t)(record->payload[4] | (record->payload[5] << 8));
+}
+
+// Initializes the iterator over the records of the dataset with indexes in
+// [begin, end). Ranges are clamped to the number of records, so that several
+// threads can each iterate over their own slice.
+void dataset_iter_init(DatasetIterator *iter, const Dataset *dataset, uint64_t begin, uint64_t end);
+
+// Returns the next record of the iterator, or NULL if there are no more.
+__CU_INLINE const DatasetRecord *dataset_iter_next(DatasetIterator *iter) {
+    return iter->index < iter->end ? dataset_record(iter->dataset, iter->index++) : NULL;
+}
+
+__CU_END_DECLS
+
+#endif
@@ -0,0 +1,83 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __CU_EPD_H__
+#define __CU_EPD_H__
+
+#include <stddef.h>
+#include "cu_core.h"
+#include "cu_position.h"
+
+__CU_BEGIN_DECLS
+
+// Structure for a span of text in an EPD file. The text is not
+// null-terminated, and stays valid until the file is closed. A NULL string
+// means that the span is absent.
+typedef struct EpdSpan_ {
+    const char *str;
+    size_t length;
+} EpdSpan;
+
+// Structure for the opcodes of an EPD record kept by the loader. Operands of
+// 'id' and 'c0' are stored without their enclosing quotes.
+typedef struct EpdOpcodes_ {
+    EpdSpan bm;
+    EpdSpan id;
+    EpdSpan c0;
+} EpdOpcodes;
+
+// Structure for an EPD file, either memory-mapped or held by the caller.
+typedef struct EpdFile_ {
+    const char *data;
+    size_t size;
+    bool mapped;
+    char err[128];
+} EpdFile;
+
+// Memory-maps the EPD file at the given path. If any error arises, it will be
+// stored in the file.
+// Returns 0 if successful, a non-null value otherwise.
+int epd_open(EpdFile *file, const char *path);
+
+// Initializes the EPD file from the given buffer of size bytes, which must stay
+// valid until the file is closed.
+void epd_open_buffer(EpdFile *file, const char *data, size_t size);
+
+// Unmaps the EPD file.
+void epd_close(EpdFile *file);
+
+// Returns the error string of the file.
+__CU_INLINE const char *epd_get_error(const EpdFile *file) {
+    return file->err;
+}
+
+// Returns the number of records of the file. Each non-blank line is a record.
+size_t epd_count_records(const EpdFile *file);
+
+// Parses the records of the file into the given array of positions, and their
+// opcodes into the given array of opcodes if not NULL, stopping after capacity
+// records. Records are made of the four fields of a FEN, optionally followed
+// by the two move counters, and then by opcodes; an 'hmvc' opcode sets the
+// fifty-move counter. The file is split at line boundaries over the given
+// number of threads (the calling thread being one of them). The number of
+// parsed records is stored in count. If any error arises, it will be stored
+// in the file, along with the index of the first invalid record.
+// Returns 0 if successful, a non-null value otherwise.
+int epd_load(EpdFile *file, Position *positions, EpdOpcodes *opcodes, size_t capacity, size_t *count, int threads);
+
+__CU_END_DECLS
+
+#endif
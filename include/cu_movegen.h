@@ -22,18 +22,48 @@
 
 __CU_BEGIN_DECLS
 
+// Enum for move generation types.
+typedef enum gentype_e {
+    CAPTURES,     // Captures and promotions.
+    QUIETS,       // Non-capturing moves, including castling.
+    QUIET_CHECKS, // Non-capturing moves giving check, including castling.
+    EVASIONS,     // All moves, for a side to move which is in check.
+    NON_EVASIONS  // All moves, for a side to move which is not in check.
+} gentype_t;
+
 // Structure for storing a list of moves for a position.
 typedef struct Movelist_ {
     move_t moves[CU_MAX_MOVES];
     move_t *end;
 } Movelist;
 
+// Structure for storing a list of moves for a position, along with a score for
+// each move (stored in a parallel array) for ordering them in place.
+typedef struct ScoredMovelist_ {
+    move_t moves[CU_MAX_MOVES];
+    int scores[CU_MAX_MOVES];
+    move_t *end;
+} ScoredMovelist;
+
 // Generate all legal moves from the given position.
 void mlist_generate_legal(Movelist *mlist, const Board *board);
 
+// Returns the number of legal moves in the given position, without generating
+// them.
+size_t board_count_legal_moves(const Board *board);
+
+// Tests if the side to move has at least one legal move, stopping at the first
+// one found.
+bool board_has_legal_move(const Board *board);
+
 // Generate all pseudo-legal moves from the given position.
 void mlist_generate_pseudo_legal(Movelist *mlist, const Board *board);
 
+// Generate all pseudo-legal moves of the given type from the given position.
+// The EVASIONS type must only be used when the side to move is in check, and
+// all other types only when the side to move is not in check.
+void mlist_generate(Movelist *mlist, const Board *board, gentype_t type);
+
 // Returns the number of moves contained in the list.
 __CU_INLINE size_t mlist_size(const Movelist *mlist) {
     return (size_t)(mlist->end - (move_t *const)mlist->moves);
@@ -68,6 +98,92 @@ __CU_INLINE bool mlist_has_move(const Movelist *mlist, move_t move) {
     return false;
 }
 
+
+// Same as mlist_generate(), but for a scored list. All scores are set to zero.
+void smlist_generate(ScoredMovelist *smlist, const Board *board, gentype_t type);
+
+// Scores all moves of the list by MVV-LVA. Quiet moves get a score of zero, and
+// captures and promotions get a positive score.
+void smlist_score_mvv_lva(ScoredMovelist *smlist, const Board *board);
+
+// Sorts the moves of the list by decreasing score. The sort is stable.
+void smlist_sort(ScoredMovelist *smlist);
+
+// Splits the moves of the list in two buckets: moves with a static exchange
+// evaluation greater than or equal to the threshold first, then the others.
+// Moves keep their scores and their relative order within each bucket.
+// Returns a pointer to the first move of the second bucket.
+move_t *smlist_split_see(ScoredMovelist *smlist, const Board *board, int threshold);
+
+// Returns the number of moves contained in the scored list.
+__CU_INLINE size_t smlist_size(const ScoredMovelist *smlist) {
+    return (size_t)(smlist->end - (move_t *const)smlist->moves);
+}
+
+// Returns a pointer to the first move in the scored list.
+__CU_INLINE move_t *smlist_begin(ScoredMovelist *smlist) {
+    return smlist->moves;
+}
+
+// Returns a pointer after the last move in the scored list.
+__CU_INLINE move_t *smlist_end(ScoredMovelist *smlist) {
+    return smlist->end;
+}
+
+// Returns a pointer to the score of the move pointed by iter.
+__CU_INLINE int *smlist_score(ScoredMovelist *smlist, const move_t *iter) {
+    return &smlist->scores[iter - smlist->moves];
+}
+
+// Swaps the best scored move between iter and the end of the list with the
+// move pointed by iter, and returns it. Calling this function with successive
+// positions of the list acts as a lazy selection sort.
+__CU_INLINE move_t smlist_pick_best(ScoredMovelist *smlist, move_t *iter) {
+    move_t *best = iter;
+
+    for (move_t *it = iter + 1; it < smlist->end; ++it)
+        if (*smlist_score(smlist, it) > *smlist_score(smlist, best))
+            best = it;
+
+    move_t move = *best;
+    int score = *smlist_score(smlist, best);
+
+    *best = *iter;
+    *smlist_score(smlist, best) = *smlist_score(smlist, iter);
+    *iter = move;
+    *smlist_score(smlist, iter) = score;
+
+    return move;
+}
+
+// Structure for iterating over the legal moves of a position in stages: the
+// transposition table move first, then captures and promotions (ordered by
+// MVV-LVA) which do not lose material, then killers and other quiet moves, and
+// finally the losing captures. Each stage is only generated when the previous
+// one is exhausted. When in check, all evasions are
+// generated at once after the transposition table move.
+typedef struct MovePicker_ {
+    const Board *board;
+    move_t ttMove;
+    move_t killers[2];
+    int stage;
+    bitboard_t pinned;
+    square_t kingSq;
+    move_t *cur;
+    move_t *endBad;
+    ScoredMovelist list;
+} MovePicker;
+
+// Initializes the move picker for the given position. ttMove can be any move
+// (it will be tested for legality before being returned), or NO_MOVE. killers
+// can be NULL, or point to two quiet moves to try first in the quiet stage.
+// The board must not be modified while the picker is in use.
+void movepicker_init(MovePicker *mp, const Board *board, move_t ttMove, const move_t killers[2]);
+
+// Returns the next legal move of the picker, or NO_MOVE once all moves have
+// been returned.
+move_t movepicker_next(MovePicker *mp);
+
 __CU_END_DECLS
 
 #endif
@@ -0,0 +1,58 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __CU_PACK_H__
+#define __CU_PACK_H__
+
+#include <stdint.h>
+#include "cu_core.h"
+
+__CU_BEGIN_DECLS
+
+// Size in bytes of a packed position.
+#define CU_PACKED_SIZE 32
+
+// Structure for a packed position. All multi-byte fields are stored in
+// little-endian order, so packed positions can be shared between hosts:
+//  - bytes 0-7: the occupancy bitboard;
+//  - bytes 8-23: one nibble per occupied square, in square order, low nibble
+//    first. Nibbles hold the piece_t of the square, except for Rooks with a
+//    castling right, which use 7 (white) and 15 (black);
+//  - byte 24: the side to move;
+//  - byte 25: the e.p. square, or SQ_NONE;
+//  - byte 26: the fifty-move counter, saturated at 255;
+//  - byte 27: zero;
+//  - bytes 28-29: the game ply, saturated at 65535;
+//  - bytes 30-31: zero.
+typedef struct PackedBoard_ {
+    uint8_t data[CU_PACKED_SIZE];
+} PackedBoard;
+
+// Packs the current position of the board. Positions with more than 32 pieces
+// cannot be packed.
+// Returns 0 if successful, a non-null value otherwise.
+int board_pack(PackedBoard *packed, const Board *board);
+
+// Initializes the board from the given packed position. Only the properties
+// needed to set up the board safely are checked, so packed positions should
+// come from board_pack().
+// If stack is NULL, all the stacks will be allocated internally.
+// Returns 0 if successful, a non-null value otherwise.
+int board_unpack(Board *board, Boardstack *stack, const PackedBoard *packed);
+
+__CU_END_DECLS
+
+#endif
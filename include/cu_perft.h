@@ -0,0 +1,70 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __CU_PERFT_H__
+#define __CU_PERFT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cu_core.h"
+
+__CU_BEGIN_DECLS
+
+// Structure for a perft cache entry. The check field holds the position key
+// XORed with the data field, so that an entry torn by concurrent writes from
+// several threads fails verification instead of returning a wrong count.
+typedef struct PerftCacheEntry_ {
+    uint64_t check;
+    uint64_t data;
+} PerftCacheEntry;
+
+// Structure for a perft cache, which can be shared by all the threads of a
+// cu_perft() call, or across several calls.
+typedef struct PerftCache_ {
+    PerftCacheEntry *entries;
+    size_t size;
+} PerftCache;
+
+// Initializes the perft cache with the given size in megabytes (rounded down
+// to a power of two number of entries, with at least one entry).
+// Returns 0 if successful, a non-null value otherwise.
+int perft_cache_init(PerftCache *cache, size_t megabytes);
+
+// Clears all entries of the perft cache.
+void perft_cache_clear(PerftCache *cache);
+
+// Frees the memory of the perft cache.
+void perft_cache_destroy(PerftCache *cache);
+
+// Returns the number of stacks cu_perft() needs for the given board, depth and
+// thread count. Each thread uses its own slice of the stack array, holding the
+// move history of the board and the stacks of the perft recursion.
+size_t cu_perft_stack_count(const Board *board, int depth, int threads);
+
+// Counts the leaf nodes of the legal move tree of the given depth, and stores
+// the result in nodes. The work is split over the given number of threads
+// (the calling thread being one of them): root moves, or pairs of moves for
+// depths of at least 3, are handed out one at a time to the first idle
+// thread. Each thread searches on its own board built with board_copy_root().
+// If stacks is NULL, all the stacks will be allocated internally, otherwise
+// it must hold at least cu_perft_stack_count() stacks. If cache is not NULL,
+// node counts of subtrees are stored in and probed from it.
+// Returns 0 if successful, a non-null value otherwise.
+int cu_perft(uint64_t *nodes, const Board *board, int depth, int threads, Boardstack *stacks, PerftCache *cache);
+
+__CU_END_DECLS
+
+#endif
@@ -0,0 +1,135 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __CU_POLYGLOT_H__
+#define __CU_POLYGLOT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cu_core.h"
+
+__CU_BEGIN_DECLS
+
+// A Polyglot book is a sequence of 16-byte entries sorted by key, all fields
+// being stored in big-endian order:
+//  - bytes 0-7: the Polyglot key of the position;
+//  - bytes 8-9: the move, with the destination square in bits 0-5, the source
+//    square in bits 6-11, and the promotion piecetype (0 for none, 1 for a
+//    Knight up to 4 for a Queen) in bits 12-14. Castling moves are encoded as
+//    the King capturing its own Rook;
+//  - bytes 10-11: the weight of the move;
+//  - bytes 12-15: learning data, unused here.
+
+#define CU_POLYGLOT_ENTRY_SIZE 16
+
+// Offsets of the castling, en-passant and side to move keys in the Polyglot
+// random array. Piece keys come first, indexed by 64 * kind + square, where
+// kind is 2 * (piecetype - 1) for Black pieces and 2 * (piecetype - 1) + 1 for
+// White pieces.
+#define CU_POLYGLOT_CASTLING_OFFSET 768
+#define CU_POLYGLOT_EP_OFFSET 772
+#define CU_POLYGLOT_TURN_OFFSET 780
+
+// The 781 random numbers of the Polyglot standard.
+extern const hashkey_t __cu_polyglot_random[781];
+
+// Returns the Polyglot key of the given piece on the given square.
+__CU_INLINE hashkey_t __polyglot_psq_key(piece_t pc, square_t sq) {
+    return __cu_polyglot_random[64 * (2 * (piece_type(pc) - 1) + (piece_color(pc) == WHITE)) + sq];
+}
+
+// Returns the Polyglot key of the given castling rights. The castling bits are
+// in the same order as the Polyglot castling keys.
+__CU_INLINE hashkey_t __polyglot_castling_key(castling_t castling) {
+    hashkey_t key = 0;
+
+    for (int i = 0; i < 4; ++i)
+        if (castling & (1 << i))
+            key ^= __cu_polyglot_random[CU_POLYGLOT_CASTLING_OFFSET + i];
+
+    return key;
+}
+
+// Returns the Polyglot key of the en-passant file of the given square.
+__CU_INLINE hashkey_t __polyglot_ep_key(square_t sq) {
+    return __cu_polyglot_random[CU_POLYGLOT_EP_OFFSET + square_file(sq)];
+}
+
+// Structure for a decoded Polyglot book entry.
+typedef struct PolyglotEntry_ {
+    hashkey_t key;
+    move_t move;
+    uint16_t weight;
+    uint32_t learn;
+} PolyglotEntry;
+
+// Structure for a Polyglot book, either memory-mapped or held by the caller.
+// The size of the data includes trailing bytes after the last entry.
+typedef struct PolyglotBook_ {
+    const uint8_t *data;
+    size_t size;
+    size_t count;
+    bool mapped;
+    char err[128];
+} PolyglotBook;
+
+// Converts the given Polyglot move to a move of the board. The move is not
+// tested for legality.
+move_t board_polyglot_move(const Board *board, uint16_t pgMove);
+
+// Memory-maps the Polyglot book at the given path. The book is never read
+// entirely: only the pages touched by lookups are loaded. If any error
+// arises, it will be stored in the book.
+// Returns 0 if successful, a non-null value otherwise.
+int polyglot_open(PolyglotBook *book, const char *path);
+
+// Initializes the Polyglot book from the given buffer of size bytes, which
+// must stay valid until the book is closed. Trailing bytes of an incomplete
+// entry are ignored.
+void polyglot_open_buffer(PolyglotBook *book, const void *data, size_t size);
+
+// Unmaps the Polyglot book.
+void polyglot_close(PolyglotBook *book);
+
+// Returns the number of entries of the book.
+__CU_INLINE size_t polyglot_size(const PolyglotBook *book) {
+    return book->count;
+}
+
+// Decodes the entry of the given index, which must be lower than the number
+// of entries.
+void polyglot_entry(const PolyglotBook *book, size_t index, PolyglotEntry *entry);
+
+// Returns the index of the first entry of the book with the given key, or the
+// number of entries if there is none. The search is a binary search.
+size_t polyglot_find(const PolyglotBook *book, hashkey_t key);
+
+// Stores the entries of the book for the current position of the board, with
+// their moves converted to moves of the board, in the given array. Entries
+// with illegal moves are skipped, and at most capacity entries are stored.
+// Returns the number of stored entries.
+size_t polyglot_probe(const PolyglotBook *book, const Board *board, PolyglotEntry *entries, size_t capacity);
+
+// Picks a book move for the current position of the board, with a
+// probability proportional to its weight. The given random number is used for
+// the selection, so that the function can be used from several threads with
+// their own generators. Moves with a weight of zero are never picked.
+// Returns the picked move, or NO_MOVE if the position has no book move.
+move_t polyglot_pick(const PolyglotBook *book, const Board *board, uint64_t random);
+
+__CU_END_DECLS
+
+#endif
@@ -0,0 +1,115 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __CU_POSITION_H__
+#define __CU_POSITION_H__
+
+#include "cu_core.h"
+#include "cu_movegen.h"
+
+__CU_BEGIN_DECLS
+
+// Structure for a compact position, fitting in two cache lines. Unlike a
+// Board, it has no history: moves are played by copying the position to a new
+// one with position_make_move(), and it can be freely copied with memcpy().
+// Its key is the same as the key of a Board holding the same position.
+typedef struct Position_ {
+    bitboard_t piecetypeBBs[KING + 1];
+    bitboard_t colorBBs[COLOR_NB];
+    hashkey_t key;
+    bitboard_t checkers;
+    uint8_t table[SQUARE_NB / 2];
+    uint8_t rule50;
+    color_t sideToMove;
+    castling_t castlingRights;
+    square_t enPassantSq;
+    square_t castlingRookSquare[4];
+} Position;
+
+// Initializes the position from the current position of the given board. The
+// fifty-move counter saturates at 255.
+void position_from_board(Position *pos, const Board *board);
+
+// Initializes the position from the given FEN.
+// Returns 0 if successful, a non-null value otherwise.
+int position_from_fen(Position *pos, const char *fen);
+
+// Writes to dst the position resulting from playing the given legal move in
+// src. The source position is left untouched.
+void position_make_move(Position *dst, const Position *src, move_t move);
+
+// Generate all legal moves from the given position.
+void position_generate_legal(Movelist *mlist, const Position *pos);
+
+// Returns the piece at the given square.
+__CU_INLINE piece_t position_piece_at(const Position *pos, square_t sq) {
+    return (pos->table[sq >> 1] >> ((sq & 1) * 4)) & 0xF;
+}
+
+// Returns the side to move.
+__CU_INLINE color_t position_turn(const Position *pos) {
+    return pos->sideToMove;
+}
+
+// Returns the Zobrist key of the position.
+__CU_INLINE hashkey_t position_key(const Position *pos) {
+    return pos->key;
+}
+
+// Returns the bitboard of pieces giving check to the side to move.
+__CU_INLINE bitboard_t position_checkers(const Position *pos) {
+    return pos->checkers;
+}
+
+// Returns the bitboard of all pieces.
+__CU_INLINE bitboard_t position_occupancy_bb(const Position *pos) {
+    return pos->piecetypeBBs[ALL_PIECES];
+}
+
+// Returns the bitboard of pieces of the given color and piecetype.
+__CU_INLINE bitboard_t position_piece_bb(const Position *pos, color_t c, piecetype_t pt) {
+    return pos->piecetypeBBs[pt] & pos->colorBBs[c];
+}
+
+// Returns the square of King of the given color.
+__CU_INLINE square_t position_king_square(const Position *pos, color_t c) {
+    return bb_first_square(position_piece_bb(pos, c, KING));
+}
+
+// Internal helpers, shared by the modules building positions.
+
+__CU_INLINE void __position_put_piece(Position *pos, piece_t pc, square_t sq) {
+    bitboard_t bb = square_bb(sq);
+
+    pos->table[sq >> 1] |= pc << ((sq & 1) * 4);
+    pos->piecetypeBBs[ALL_PIECES] |= bb;
+    pos->piecetypeBBs[piece_type(pc)] |= bb;
+    pos->colorBBs[piece_color(pc)] |= bb;
+}
+
+// Returns the bitboard of attackers of the given color for the given square,
+// using the given occupancy for slider attacks.
+__CU_INLINE bitboard_t __position_attackers(const Position *pos, square_t sq, color_t c, bitboard_t occupancy) {
+    return ((pawn_moves_bb(sq, flip_color(c)) & pos->piecetypeBBs[PAWN])
+        | (knight_moves_bb(sq) & pos->piecetypeBBs[KNIGHT])
+        | (bishop_moves_bb(sq, occupancy) & (pos->piecetypeBBs[BISHOP] | pos->piecetypeBBs[QUEEN]))
+        | (rook_moves_bb(sq, occupancy) & (pos->piecetypeBBs[ROOK] | pos->piecetypeBBs[QUEEN]))
+        | (king_moves_bb(sq) & pos->piecetypeBBs[KING])) & pos->colorBBs[c];
+}
+
+__CU_END_DECLS
+
+#endif
@@ -0,0 +1,151 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __CU_TT_H__
+#define __CU_TT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cu_core.h"
+
+__CU_BEGIN_DECLS
+
+// Number of entries in a cluster of the transposition table. Clusters are 32
+// bytes long, so that two of them share a cache line.
+#define CU_TT_CLUSTER_SIZE 3
+
+// Offset of the depths stored in the transposition table. A stored depth of
+// zero marks an empty entry, so the lowest depth which can be stored is -7, and
+// lower depths are stored as -7.
+#define CU_TT_DEPTH_OFFSET -8
+
+// Typedef for the bound of a transposition table score.
+typedef uint8_t bound_t;
+
+// Enum for bound values.
+enum bound_e {
+    BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT = BOUND_UPPER | BOUND_LOWER
+};
+
+// Structure for a transposition table entry. Only the upper 16 bits of the key
+// are stored, the lower bits being given by the index of the cluster. Entries
+// are read and written without locks: a torn entry can only be detected by
+// its key bits, so the move must be tested for legality before being played.
+typedef struct TTEntry_ {
+    uint16_t key16;
+    move_t move;
+    int16_t score;
+    int16_t eval;
+    uint8_t depth8;
+    uint8_t genBound8;
+} TTEntry;
+
+// Structure for a cluster of transposition table entries.
+typedef struct TTCluster_ {
+    TTEntry entries[CU_TT_CLUSTER_SIZE];
+    uint8_t padding[2];
+} TTCluster;
+
+// Structure for a transposition table, which can be shared by several threads.
+// The generation is increased at each new search, so that entries of older
+// searches get replaced first.
+typedef struct TranspositionTable_ {
+    TTCluster *clusters;
+    size_t clusterCount;
+    uint8_t generation8;
+} TranspositionTable;
+
+// Initializes the transposition table with the given size in megabytes
+// (rounded down to a power of two number of clusters, with at least two
+// clusters). The table is cleared with the given number of threads.
+// Returns 0 if successful, a non-null value otherwise.
+int tt_init(TranspositionTable *tt, size_t megabytes, int threads);
+
+// Frees the memory of the transposition table.
+void tt_destroy(TranspositionTable *tt);
+
+// Clears all entries of the transposition table and resets its generation.
+// The work is split over the given number of threads (the calling thread
+// being one of them).
+void tt_clear(TranspositionTable *tt, int threads);
+
+// Increases the generation of the transposition table. It should be called
+// before each new search.
+__CU_INLINE void tt_new_search(TranspositionTable *tt) {
+    tt->generation8 += 8;
+}
+
+// Returns the cluster for the given key.
+__CU_INLINE TTCluster *tt_cluster(const TranspositionTable *tt, hashkey_t key) {
+    return &tt->clusters[key & (tt->clusterCount - 1)];
+}
+
+// Prefetches the cluster for the given key into the cache, so that a probe
+// made after other work does not wait for memory.
+__CU_INLINE void tt_prefetch(const TranspositionTable *tt, hashkey_t key) {
+#if CU_USE_BUILTINS
+    __builtin_prefetch(tt_cluster(tt, key));
+#else
+    (void)tt;
+    (void)key;
+#endif
+}
+
+// Looks up the given key in the transposition table. If an entry with the key
+// is found, found is set to true and the entry is returned. Otherwise, found
+// is set to false and the entry to be replaced is returned, preferring empty
+// entries, then entries of older generations and lower depths.
+TTEntry *tt_probe(TranspositionTable *tt, hashkey_t key, bool *found);
+
+// Stores the given data in the entry returned by tt_probe() for the key. The
+// previous move is kept if the given move is NO_MOVE and the key is the same.
+// The previous data is kept if it has the same key, the current generation
+// and a depth greater by more than 3 plies, unless the new bound is exact.
+void tt_save(const TranspositionTable *tt, TTEntry *entry, hashkey_t key, int score, int eval,
+    bound_t bound, int depth, move_t move);
+
+// Returns the approximate number of entries of the current generation per
+// thousand entries of the table, based on a sample of the first clusters.
+int tt_hashfull(const TranspositionTable *tt);
+
+// Returns the move of the entry.
+__CU_INLINE move_t tt_entry_move(const TTEntry *entry) {
+    return entry->move;
+}
+
+// Returns the score of the entry.
+__CU_INLINE int tt_entry_score(const TTEntry *entry) {
+    return entry->score;
+}
+
+// Returns the static evaluation of the entry.
+__CU_INLINE int tt_entry_eval(const TTEntry *entry) {
+    return entry->eval;
+}
+
+// Returns the depth of the entry.
+__CU_INLINE int tt_entry_depth(const TTEntry *entry) {
+    return entry->depth8 + CU_TT_DEPTH_OFFSET;
+}
+
+// Returns the bound of the entry.
+__CU_INLINE bound_t tt_entry_bound(const TTEntry *entry) {
+    return entry->genBound8 & BOUND_EXACT;
+}
+
+__CU_END_DECLS
+
+#endif
@@ -15,48 +15,127 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <ctype.h>
-#include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include "cu_board_internal.h"
 #include "cu_core.h"
 #include "cu_movegen.h"
+#include "cu_polyglot.h"
 
 const char *const STARTING_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 const char PIECE_INDEXES[PIECE_NB] = " PNBRQK  pnbrqk";
 
-__CU_INLINE Boardstack *__boardstack_dup(Boardstack *stack) {
-    if (!stack)
-        return NULL;
+// Number of stacks in the first block of the internal stack allocator. Each
+// following block is twice as large as the previous one.
+#define CU_STACK_BLOCK_SIZE 64
 
-    Boardstack *newStack = malloc(sizeof(Boardstack));
-    if (newStack == NULL)
-        return NULL;
+// Creates a new block of stacks after the given one (which may be NULL).
+static BoardstackBlock *__boardstack_block_new(BoardstackBlock *prev, size_t size) {
+    BoardstackBlock *block = malloc(sizeof(BoardstackBlock) + sizeof(Boardstack) * size);
 
-    *newStack = *stack;
-    newStack->prev = __boardstack_dup(stack->prev);
-    if (newStack->prev == NULL && stack->prev != NULL) {
-        free(newStack);
+    if (block == NULL)
         return NULL;
+
+    block->prev = prev;
+    block->next = NULL;
+    block->stacks = (Boardstack *)(block + 1);
+    block->size = size;
+    block->used = 0;
+    block->external = false;
+
+    if (prev)
+        prev->next = block;
+
+    return block;
+}
+
+// Takes a stack from the internal allocator of the board, moving to the next
+// block (or creating it) if the current one is full. Returns NULL if out of
+// memory.
+static Boardstack *__board_alloc_stack(Board *board) {
+    BoardstackBlock *block = board->stackBlock;
+
+    if (block == NULL || block->used == block->size) {
+        BoardstackBlock *next = block ? block->next : NULL;
+
+        if (next == NULL) {
+            next = __boardstack_block_new(block, block ? __cu_max(block->size * 2, CU_STACK_BLOCK_SIZE) : CU_STACK_BLOCK_SIZE);
+
+            if (next == NULL)
+                return NULL;
+        }
+
+        board->stackBlock = block = next;
     }
 
-    return (newStack);
+    return &block->stacks[block->used++];
+}
+
+// Gives back the given stack to the internal allocator of the board. Stacks
+// which don't come from the allocator (like a root stack provided by the
+// caller) are left untouched.
+static void __board_free_stack(Board *board, const Boardstack *stack) {
+    BoardstackBlock *block = board->stackBlock;
+
+    // The current block can be empty if a stack buffer was inserted after a
+    // block still in use.
+    while (block && block->used == 0 && block->prev)
+        block = block->prev;
+
+    if (block == NULL || block->used == 0 || stack != &block->stacks[block->used - 1])
+        return;
+
+    --block->used;
+    board->stackBlock = (block->used == 0 && block->prev) ? block->prev : block;
 }
 
-__CU_INLINE void __boardstack_free(Boardstack *stack) {
-    while (stack) {
-        Boardstack *prev = stack->prev;
-        free(stack);
-        stack = prev;
+// Frees all the blocks of the internal allocator of the board.
+static void __board_free_blocks(Board *board) {
+    BoardstackBlock *block = board->stackBlock;
+
+    if (block == NULL)
+        return;
+
+    while (block->prev)
+        block = block->prev;
+
+    // The stacks of external blocks belong to the caller, but their block
+    // itself is allocated separately.
+    while (block) {
+        BoardstackBlock *next = block->next;
+
+        free(block);
+        block = next;
     }
+
+    board->stackBlock = NULL;
 }
 
-__CU_INLINE void __board_put_piece(Board *board, piece_t pc, square_t sq) {
-    board->table[sq] = pc;
-    board->piecetypeBBs[ALL_PIECES]     |= square_bb(sq);
-    board->piecetypeBBs[piece_type(pc)] |= square_bb(sq);
-    board->colorBBs[piece_color(pc)]    |= square_bb(sq);
-    board->pieceCounts[pc]++;
-    board->pieceCounts[create_piece(piece_color(pc), ALL_PIECES)]++;
+// Copies the chain of stacks ending with the given one to the internal
+// allocator of the board, which must not have any block yet. All stacks are
+// placed in a single block, from the root one to the given one.
+static Boardstack *__board_dup_stacks(Board *board, const Boardstack *stack) {
+    size_t count = 0;
+
+    for (const Boardstack *it = stack; it; it = it->prev)
+        ++count;
+
+    board->stackBlock = __boardstack_block_new(NULL, __cu_max(count, CU_STACK_BLOCK_SIZE));
+
+    if (board->stackBlock == NULL)
+        return NULL;
+
+    Boardstack *stacks = board->stackBlock->stacks;
+
+    board->stackBlock->used = count;
+
+    for (size_t i = count; i-- > 0; stack = stack->prev) {
+        stacks[i] = *stack;
+        stacks[i].prev = i ? &stacks[i - 1] : NULL;
+    }
+
+    return &stacks[count - 1];
 }
 
 __CU_INLINE void __board_move_piece(Board *board, square_t from, square_t to) {
@@ -134,18 +213,19 @@ bitboard_t __board_slider_blockers(const Board *board, bitboard_t sliders, squar
     return blockers;
 }
 
-void __board_set_check(Board *board, Boardstack *stack) {
-    color_t them = flip_color(board_turn(board));
+void __board_compute_blockers(const Board *board, color_t c) {
+    Boardstack *stack = board->stack;
 
-    stack->checkBlockers[WHITE] = __board_slider_blockers(board,
-        board_color_bb(board, BLACK),
-        board_king_square(board, WHITE),
-        &stack->checkPinners[BLACK]);
-    stack->checkBlockers[BLACK] = __board_slider_blockers(board,
-        board_color_bb(board, WHITE),
-        board_king_square(board, BLACK),
-        &stack->checkPinners[WHITE]);
+    stack->checkBlockers[c] = __board_slider_blockers(board,
+        board_color_bb(board, flip_color(c)),
+        board_king_square(board, c),
+        &stack->checkPinners[flip_color(c)]);
+    stack->checkInfo |= CHECKINFO_WHITE_BLOCKERS << c;
+}
 
+void __board_compute_check_squares(const Board *board) {
+    Boardstack *stack = board->stack;
+    color_t them = flip_color(board_turn(board));
     square_t kingSq = board_king_square(board, them);
 
     stack->checkSquares[PAWN]   = pawn_moves_bb(kingSq, them);
@@ -154,69 +234,169 @@ void __board_set_check(Board *board, Boardstack *stack) {
     stack->checkSquares[ROOK]   = rook_moves_bb(kingSq, board_occupancy_bb(board));
     stack->checkSquares[QUEEN]  = stack->checkSquares[BISHOP] | stack->checkSquares[ROOK];
     stack->checkSquares[KING]   = 0;
+    stack->checkInfo |= CHECKINFO_SQUARES;
+}
+
+// Returns the index of the given key in the key filter of a board.
+__CU_INLINE size_t __board_key_filter_index(hashkey_t key) {
+    return (size_t)(key >> (64 - CU_KEY_FILTER_BITS));
 }
 
-int __board_set_stack(Board *board, Boardstack *stack) {
+// Returns true if the key history still holds the keys of the given number of
+// last plies. A slot is overwritten by any line played 256 plies deeper, even
+// after that line has been taken back.
+static bool __board_history_covers(const Board *board, int plies) {
+    for (int ply = board->historyPly - plies; ply < board->historyPly; ++ply)
+        if (board->keyHistoryPly[ply & (CU_KEY_HISTORY_SIZE - 1)] != ply)
+            return false;
+
+    return true;
+}
+
+// Returns the number of earlier occurrences of the current position since the
+// last irreversible move or null move.
+static int __board_count_repetitions(const Board *board) {
+    const Boardstack *stack = board->stack;
+    int repetitionPlies = __cu_min(stack->rule50, stack->lastNullmove);
+    int repetition = 0;
+
+    if (repetitionPlies < CU_KEY_HISTORY_SIZE && __board_history_covers(board, repetitionPlies)) {
+        for (int i = 4; i <= repetitionPlies; i += 2)
+            repetition += board->keyHistory[(board->historyPly - i) & (CU_KEY_HISTORY_SIZE - 1)] == stack->key;
+
+        return repetition;
+    }
+
+    // The history doesn't go back far enough, walk the stacks instead.
+    const Boardstack *stackIt = stack->prev->prev;
+
+    for (int i = 4; i <= repetitionPlies; i += 2) {
+        stackIt = stackIt->prev->prev;
+
+        if (stackIt->key == stack->key)
+            return stackIt->repetition + 1;
+    }
+
+    return 0;
+}
+
+// Adds the key of the current stack to the key history of the board, and
+// returns the number of earlier occurrences of the current position. The
+// history is only searched if the key filter reports a possible match.
+static int __board_record_key(Board *board) {
+    hashkey_t key = board->stack->key;
+    uint16_t *filter = &board->keyFilter[__board_key_filter_index(key)];
+
+    ++board->historyPly;
+    board->keyHistory[board->historyPly & (CU_KEY_HISTORY_SIZE - 1)] = key;
+    board->keyHistoryPly[board->historyPly & (CU_KEY_HISTORY_SIZE - 1)] = board->historyPly;
+
+    if ((*filter)++ == 0 || __cu_min(board->stack->rule50, board->stack->lastNullmove) < 4)
+        return 0;
+
+    return __board_count_repetitions(board);
+}
+
+int __board_init_root(Board *board, Boardstack *stack) {
+    board->err[0] = '\0';
+    board->stackBlock = NULL;
+    board->internalStackAllocator = (stack == NULL);
+
+    if (stack == NULL) {
+        stack = __board_alloc_stack(board);
+        if (stack == NULL) {
+            board_set_error(board, "Out of memory");
+            return -2;
+        }
+    }
+
+    board->stack = stack;
+    return 0;
+}
+
+int __board_init(Board *board, Boardstack *stack) {
+    // The key history doesn't need to be cleared, as it is only read for the
+    // plies played from the root, and the key filter is cleared when the
+    // root stack is completed.
+    memset(board, 0, offsetof(Board, keyHistory));
+
+    int ret = __board_init_root(board, stack);
+
+    if (ret)
+        return ret;
+
+    memset(board->stack, 0, sizeof(Boardstack));
+    return 0;
+}
+
+int __board_finish_root(Board *board) {
+    Boardstack *stack = board->stack;
     color_t us = board_turn(board), them = flip_color(board_turn(board));
-    stack->key = stack->materialKey = 0;
-    stack->checkers = board_attackers(board, board_king_square(board, us), them);
 
     // If we're attacking the opponent's King and it's our turn to move, the
-    // FEN is invalid.
+    // position is invalid.
     if (board_attackers(board, board_king_square(board, them), us)) {
         board_set_error(board, "Side to move can already capture the enemy King");
         return -1;
     }
 
-    __board_set_check(board, stack);
-
-    // Initialize board Zobrist key.
-    for (bitboard_t bb = board_occupancy_bb(board); bb; ) {
-        square_t sq = bb_pop_first_square(&bb);
-        piece_t pc = board_piece_at(board, sq);
-
-        stack->key ^= __cu_zobrist_psq[pc][sq];
-    }
+    stack->checkers = board_attackers(board, board_king_square(board, us), them);
+    stack->checkInfo = 0;
 
     if (stack->enPassantSq != SQ_NONE)
         stack->key ^= __cu_zobrist_ep[square_file(stack->enPassantSq)];
 
+    if (stack->polyglotEP != SQ_NONE && (pawn_moves_bb(stack->polyglotEP, them) & board_piece_bb(board, us, PAWN)))
+        stack->polyglotKey ^= __polyglot_ep_key(stack->polyglotEP);
+
     if (board_turn(board) == BLACK)
         stack->key ^= __cu_zobrist_turn;
+    else
+        stack->polyglotKey ^= __cu_polyglot_random[CU_POLYGLOT_TURN_OFFSET];
 
     stack->key ^= __cu_zobrist_castling[stack->castlingRights];
+    stack->polyglotKey ^= __polyglot_castling_key(stack->castlingRights);
 
-    // Initialize material Zobrist key.
+    board->historyPly = 0;
+    board->keyHistory[0] = stack->key;
+    board->keyHistoryPly[0] = 0;
+    memset(board->keyFilter, 0, sizeof(board->keyFilter));
+    board->keyFilter[__board_key_filter_index(stack->key)] = 1;
+    return 0;
+}
+
+int __board_finish_init(Board *board) {
+    Boardstack *stack = board->stack;
+
+    stack->key = stack->materialKey = stack->polyglotKey = 0;
+
+    // Initialize board Zobrist key.
+    for (bitboard_t bb = board_occupancy_bb(board); bb; ) {
+        square_t sq = bb_pop_first_square(&bb);
+        piece_t pc = board_piece_at(board, sq);
+
+        stack->key ^= __cu_zobrist_psq[pc][sq];
+        stack->polyglotKey ^= __polyglot_psq_key(pc, sq);
+    }
 
+    // Initialize material Zobrist key.
     for (color_t c = WHITE; c <= BLACK; ++c)
-        for (piecetype_t pt = PAWN; pt <= KING; ++pt)
-        {
+        for (piecetype_t pt = PAWN; pt <= KING; ++pt) {
             piece_t pc = create_piece(c, pt);
 
             for (int i = 0; i < board_count_piece(board, pc); ++i)
                 stack->materialKey ^= __cu_zobrist_psq[pc][i];
         }
 
-    return 0;
+    return __board_finish_root(board);
 }
 
 int board_from_fen(Board *board, Boardstack *stack, const char *fen) {
     const char *whitespaces = " \t\r\n";
+    int ret = __board_init(board, stack);
 
-    memset(board, 0, sizeof(Board));
-
-    if (stack == NULL) {
-        board->internalStackAllocator = true;
-        stack = calloc(1, sizeof(Boardstack));
-        if (stack == NULL) {
-            board_set_error(board, "Out of memory");
-            return -2;
-        }
-    }
-    else
-        memset(stack, 0, sizeof(Boardstack));
-
-    board->stack = stack;
+    if (ret)
+        return ret;
 
     // Skip any trailing whitespaces. Note that we don't skip '\f'
     // and '\v', because their presence might suggest something went
@@ -354,7 +534,7 @@ int board_from_fen(Board *board, Boardstack *stack, const char *fen) {
     fen += strspn(fen, whitespaces);
     nextSection = strcspn(fen, whitespaces);
 
-    board->stack->enPassantSq = SQ_NONE;
+    board->stack->enPassantSq = board->stack->polyglotEP = SQ_NONE;
 
     // Parse the e.p. section of the FEN.
     if (nextSection == 1 && *fen != '-') {
@@ -415,14 +595,14 @@ int board_from_fen(Board *board, Boardstack *stack, const char *fen) {
     board->gamePly = __cu_max(0, 2 * board->gamePly - 2);
     board->gamePly += board->sideToMove == BLACK;
 
-    return __board_set_stack(board, board->stack);
+    return __board_finish_init(board);
 }
 
 void board_destroy(Board *board) {
     board_set_error(board, NULL);
 
     if (board->internalStackAllocator) {
-        __boardstack_free(board->stack);
+        __board_free_blocks(board);
         board->stack = NULL;
     }
 }
@@ -440,14 +620,68 @@ void board_set_error(Board *board, const char *str) {
         strcpy(board->err, str);
 }
 
+int board_use_stack_buffer(Board *board, Boardstack *buffer, size_t size) {
+    BoardstackBlock *prev = board->internalStackAllocator ? board->stackBlock : NULL;
+    BoardstackBlock *first = prev;
+
+    while (first && first->prev)
+        first = first->prev;
+
+    for (const BoardstackBlock *it = first; it; it = it->next)
+        if (it->external) {
+            board_set_error(board, "Stack buffer already set");
+            return -1;
+        }
+
+    if (size == 0) {
+        board_set_error(board, "Empty stack buffer");
+        return -1;
+    }
+
+    // The block describing the buffer is allocated like the other blocks, so
+    // that the board itself can still be moved.
+    BoardstackBlock *block = malloc(sizeof(BoardstackBlock));
+
+    if (block == NULL) {
+        board_set_error(board, "Out of memory");
+        return -2;
+    }
+
+    // Insert the buffer right after the current block, so that the stacks
+    // already in use are given back in LIFO order.
+    block->prev = prev;
+    block->next = prev ? prev->next : NULL;
+    block->stacks = buffer;
+    block->size = size;
+    block->used = 0;
+    block->external = true;
+
+    if (block->next)
+        block->next->prev = block;
+
+    if (prev)
+        prev->next = block;
+
+    board->stackBlock = block;
+    board->internalStackAllocator = true;
+    return 0;
+}
+
+// Resets the allocator fields of a board copied from another one, so that
+// the copy doesn't share any block with the source.
+__CU_INLINE void __board_reset_allocator(Board *board) {
+    board->stackBlock = NULL;
+}
+
 int board_copy_root(Board *dst, const Board *src, Boardstack *stack) {
     *dst = *src;
+    __board_reset_allocator(dst);
     dst->internalStackAllocator = false;
     board_reset(dst);
 
     if (!stack) {
         dst->internalStackAllocator = true;
-        dst->stack = __boardstack_dup(src->stack);
+        dst->stack = __board_dup_stacks(dst, dst->stack);
 
         if (dst->stack == NULL) {
             board_set_error(dst, "Out of memory");
@@ -464,8 +698,9 @@ int board_copy_root(Board *dst, const Board *src, Boardstack *stack) {
 
 int board_copy(Board *dst, const Board *src) {
     *dst = *src;
+    __board_reset_allocator(dst);
     dst->internalStackAllocator = true;
-    dst->stack = __boardstack_dup(src->stack);
+    dst->stack = __board_dup_stacks(dst, src->stack);
 
     if (dst->stack == NULL) {
         board_set_error(dst, "Out of memory");
@@ -475,6 +710,102 @@ int board_copy(Board *dst, const Board *src) {
     return 0;
 }
 
+void board_copy_shallow(Board *dst, const Board *src) {
+    // The check info of the shared stack is computed lazily, so fill it now:
+    // the accessors of both boards will then only read it.
+    board_check_blockers(src, WHITE);
+    board_check_blockers(src, BLACK);
+    board_check_squares(src, PAWN);
+
+    *dst = *src;
+    __board_reset_allocator(dst);
+    dst->internalStackAllocator = true;
+}
+
+bool board_move_is_pseudo_legal(const Board *board, move_t move) {
+    color_t us = board_turn(board), them = flip_color(board_turn(board));
+    square_t from = move_from(move), to = move_to(move);
+    piece_t piece = board_piece_at(board, from);
+    bitboard_t occupancy = board_occupancy_bb(board);
+    bitboard_t checkers = board->stack->checkers;
+    castling_t castling;
+
+    // The move must be valid, start from one of our pieces, and only carry
+    // promotion bits if it is a promotion.
+    if (!is_valid_move(move) || piece == NO_PIECE || piece_color(piece) != us
+        || (move_type(move) != PROMOTION && promotion_type(move) != KNIGHT))
+        return false;
+
+    switch (move_type(move)) {
+        case CASTLING:
+            // The move must match one of our remaining castlings, which can
+            // only be played when not in check and with an empty path.
+            castling = castling_color_mask(us) & (to > from ? KINGSIDE_CASTLING : QUEENSIDE_CASTLING);
+
+            return piece_type(piece) == KING && !checkers
+                && !!(board->stack->castlingRights & castling)
+                && board->castlingRookSquare[castling] == to
+                && !board_castling_blocked(board, castling);
+
+        case EN_PASSANT:
+            if (piece_type(piece) != PAWN || to != board->stack->enPassantSq
+                || !(pawn_moves_bb(from, us) & square_bb(to)))
+                return false;
+            break ;
+
+        case PROMOTION:
+            if (piece_type(piece) != PAWN || relative_square_rank(from, us) != RANK_7)
+                return false;
+            break ;
+
+        default:
+            // Pawns reaching the last rank must promote.
+            if (piece_type(piece) == PAWN && relative_square_rank(to, us) == RANK_8)
+                return false;
+            break ;
+    }
+
+    if (piece_type(piece) == PAWN) {
+        if (move_type(move) != EN_PASSANT) {
+            bitboard_t pushes = bb_relative_shift_north(square_bb(from), us) & ~occupancy;
+
+            if (relative_square_rank(from, us) == RANK_2)
+                pushes |= bb_relative_shift_north(pushes, us) & ~occupancy;
+
+            if (!(((pawn_moves_bb(from, us) & board_color_bb(board, them)) | pushes) & square_bb(to)))
+                return false;
+        }
+    }
+    else if (!(attacks_bb(piece_type(piece), from, occupancy) & ~board_color_bb(board, us) & square_bb(to)))
+        return false;
+
+    if (!checkers)
+        return true;
+
+    // When in check, only keep the moves produced by the evasion generator:
+    // King moves cannot stay on the line of a checking slider, and other
+    // moves must capture or block the single checker.
+    square_t kingSq = board_king_square(board, us);
+
+    if (piece_type(piece) == KING) {
+        for (bitboard_t sliders = checkers & ~board_piecetypes_bb(board, PAWN, KNIGHT); sliders; ) {
+            square_t checkSq = bb_pop_first_square(&sliders);
+
+            if ((__cu_line_bb[checkSq][kingSq] ^ square_bb(checkSq)) & square_bb(to))
+                return false;
+        }
+        return true;
+    }
+
+    if (more_than_one_bit(checkers))
+        return false;
+
+    square_t checkSq = bb_first_square(checkers);
+    square_t targetSq = move_type(move) == EN_PASSANT ? to - pawn_direction(us) : to;
+
+    return !!((between_squares_bb(checkSq, kingSq) | checkers) & square_bb(targetSq));
+}
+
 bool board_move_is_legal(const Board *board, move_t move) {
     color_t us = board_turn(board), them = flip_color(board_turn(board));
     square_t from = move_from(move), to = move_to(move);
@@ -510,7 +841,7 @@ bool board_move_is_legal(const Board *board, move_t move) {
 
     // If the moving piece is pinned, test if the move generates a discovered
     // check.
-    return !(board->stack->checkBlockers[us] & square_bb(from)) || squares_aligned(from, to, board_king_square(board, us));
+    return !(board_check_blockers(board, us) & square_bb(from)) || squares_aligned(from, to, board_king_square(board, us));
 }
 
 bool board_move_gives_check(const Board *board, move_t move) {
@@ -521,12 +852,12 @@ bool board_move_gives_check(const Board *board, move_t move) {
     color_t us = board_turn(board), them = flip_color(board_turn(board));
 
     // Test if the move is a direct check.
-    if (board->stack->checkSquares[piece_type(board_piece_at(board, from))] & square_bb(to))
+    if (board_check_squares(board, piece_type(board_piece_at(board, from))) & square_bb(to))
         return true;
 
     // Test if the move is a discovered check.
     theirKing = board_king_square(board, them);
-    if (!!(board->stack->checkBlockers[them] & square_bb(from)) && !squares_aligned(from, to, theirKing))
+    if (!!(board_check_blockers(board, them) & square_bb(from)) && !squares_aligned(from, to, theirKing))
         return true;
 
     switch (move_type(move)) {
@@ -559,24 +890,62 @@ bool board_move_gives_check(const Board *board, move_t move) {
     }
 }
 
+hashkey_t board_key_after(const Board *board, move_t move) {
+    const Boardstack *stack = board->stack;
+    color_t us = board_turn(board), them = flip_color(board_turn(board));
+    square_t from = move_from(move), to = move_to(move);
+    piece_t pc = board_piece_at(board, from);
+    hashkey_t key = stack->key ^ __cu_zobrist_turn;
+
+    if (move_type(move) == CASTLING) {
+        bool kingside = to > from;
+        piece_t rook = board_piece_at(board, to);
+
+        key ^= __cu_zobrist_psq[rook][to] ^ __cu_zobrist_psq[rook][relative_square(kingside ? SQ_F1 : SQ_D1, us)];
+        to = relative_square(kingside ? SQ_G1 : SQ_C1, us);
+    }
+    else if (move_type(move) == EN_PASSANT) {
+        square_t captureSq = to - pawn_direction(us);
+
+        key ^= __cu_zobrist_psq[create_piece(them, PAWN)][captureSq];
+    }
+
+    else if (board_piece_at(board, to))
+        key ^= __cu_zobrist_psq[board_piece_at(board, to)][to];
+
+    key ^= __cu_zobrist_psq[pc][from] ^ __cu_zobrist_psq[pc][to];
+
+    if (stack->enPassantSq != SQ_NONE)
+        key ^= __cu_zobrist_ep[square_file(stack->enPassantSq)];
+
+    castling_t castling = board->castlingMasks[from] | board->castlingMasks[to];
+
+    if (stack->castlingRights & castling)
+        key ^= __cu_zobrist_castling[stack->castlingRights] ^ __cu_zobrist_castling[stack->castlingRights & ~castling];
+
+    if (piece_type(pc) == PAWN) {
+        if ((to ^ from) == 16 && (pawn_moves_bb(to - pawn_direction(us), us) & board_piece_bb(board, them, PAWN)))
+            key ^= __cu_zobrist_ep[square_file(to)];
+
+        else if (move_type(move) == PROMOTION)
+            key ^= __cu_zobrist_psq[pc][to] ^ __cu_zobrist_psq[create_piece(us, promotion_type(move))][to];
+    }
+
+    return key;
+}
+
 bool board_is_checkmate(const Board *board) {
     if (!board->stack->checkers)
         return false;
 
-    Movelist mlist;
-
-    mlist_generate_legal(&mlist, board);
-    return !mlist_size(&mlist);
+    return !board_has_legal_move(board);
 }
 
 bool board_is_stalemate(const Board *board) {
     if (board->stack->checkers)
         return false;
 
-    Movelist mlist;
-
-    mlist_generate_legal(&mlist, board);
-    return !mlist_size(&mlist);
+    return !board_has_legal_move(board);
 }
 
 bool board_is_material_draw(const Board *board) {
@@ -600,39 +969,29 @@ bool board_is_rule75_draw(const Board *board) {
     if (board_rule50(board) < 150)
         return false;
 
-    Movelist mlist;
-
-    mlist_generate_legal(&mlist, board);
-    return !!mlist_size(&mlist);
+    return board_has_legal_move(board);
 }
 
 bool board_is_rule50_draw(const Board *board) {
     if (board_rule50(board) < 100)
         return false;
 
-    Movelist mlist;
-
-    mlist_generate_legal(&mlist, board);
-    return !!mlist_size(&mlist);
+    return board_has_legal_move(board);
 }
 
 outcome_t board_outcome(const Board *board, bool claimDraw) {
-    Movelist mlist;
-
-    mlist_generate_legal(&mlist, board);
-
     // Test if the side to move is checkmated/stalemated.
-    if (!mlist_size(&mlist)) {
+    if (!board_has_legal_move(board)) {
         if (!board->stack->checkers)
             return DRAWN_GAME;
 
         return board->sideToMove == WHITE ? BLACK_WINS : WHITE_WINS;
     }
 
-    if (board_rule50(board) >= 150 || board->stack->repetition >= 5)
+    if (board_rule50(board) >= 150 || board_is_fivefold_draw(board))
         return DRAWN_GAME;
 
-    if (claimDraw && (board_rule50(board) >= 100 || board->stack->repetition >= 3))
+    if (claimDraw && (board_rule50(board) >= 100 || board_is_threefold_draw(board)))
         return DRAWN_GAME;
 
     return NO_OUTCOME;
@@ -640,7 +999,7 @@ outcome_t board_outcome(const Board *board, bool claimDraw) {
 
 int board_push(Board *board, move_t move, Boardstack *stack) {
     if (board->internalStackAllocator) {
-        stack = malloc(sizeof(Boardstack));
+        stack = __board_alloc_stack(board);
 
         if (stack == NULL) {
             board_set_error(board, "Out of memory");
@@ -650,6 +1009,7 @@ int board_push(Board *board, move_t move, Boardstack *stack) {
 
     bool givesCheck = board_move_gives_check(board, move);
     hashkey_t key = board->stack->key ^ __cu_zobrist_turn;
+    hashkey_t polyglotKey = board->stack->polyglotKey ^ __cu_polyglot_random[CU_POLYGLOT_TURN_OFFSET];
 
     stack->castlingRights = board->stack->castlingRights;
     stack->rule50         = board->stack->rule50 + 1;
@@ -682,6 +1042,7 @@ int board_push(Board *board, move_t move, Boardstack *stack) {
         __board_put_piece(board, create_piece(us, ROOK), rookTo);
 
         key ^= __cu_zobrist_psq[captured][rookFrom] ^ __cu_zobrist_psq[captured][rookTo];
+        polyglotKey ^= __polyglot_psq_key(captured, rookFrom) ^ __polyglot_psq_key(captured, rookTo);
         captured = NO_PIECE;
     }
 
@@ -697,21 +1058,28 @@ int board_push(Board *board, move_t move, Boardstack *stack) {
             board->table[captureSq] = NO_PIECE;
 
         key ^= __cu_zobrist_psq[captured][captureSq];
+        polyglotKey ^= __polyglot_psq_key(captured, captureSq);
         stack->materialKey ^= __cu_zobrist_psq[captured][board_count_piece(board, captured)];
         stack->rule50 = 0;
     }
 
     key ^= __cu_zobrist_psq[pc][from] ^ __cu_zobrist_psq[pc][to];
+    polyglotKey ^= __polyglot_psq_key(pc, from) ^ __polyglot_psq_key(pc, to);
 
+    // The en-passant square is only set when an enemy Pawn attacks it, which
+    // is also the condition for hashing its file in the Polyglot key.
     if (stack->enPassantSq != SQ_NONE) {
         key ^= __cu_zobrist_ep[square_file(board->stack->enPassantSq)];
+        polyglotKey ^= __polyglot_ep_key(board->stack->enPassantSq);
         stack->enPassantSq = SQ_NONE;
     }
 
-    if (stack->castlingRights && (board->castlingMasks[from] | board->castlingMasks[to])) {
+    if (stack->castlingRights & (board->castlingMasks[from] | board->castlingMasks[to])) {
         castling_t castling = board->castlingMasks[from] | board->castlingMasks[to];
-        key ^= __cu_zobrist_castling[stack->castlingRights & castling];
+        key ^= __cu_zobrist_castling[stack->castlingRights];
+        polyglotKey ^= __polyglot_castling_key(stack->castlingRights & castling);
         stack->castlingRights &= ~castling;
+        key ^= __cu_zobrist_castling[stack->castlingRights];
     }
 
     if (move_type(move) != CASTLING)
@@ -724,6 +1092,7 @@ int board_push(Board *board, move_t move, Boardstack *stack) {
             if (pawn_moves_bb(to - pawn_direction(us), us) & board_piece_bb(board, them, PAWN)) {
                 stack->enPassantSq = to - pawn_direction(us);
                 key ^= __cu_zobrist_ep[square_file(stack->enPassantSq)];
+                polyglotKey ^= __polyglot_ep_key(stack->polyglotEP);
             }
         }
         else if (move_type(move) == PROMOTION) {
@@ -733,6 +1102,7 @@ int board_push(Board *board, move_t move, Boardstack *stack) {
             __board_put_piece(board, newPc, to);
 
             key ^= __cu_zobrist_psq[pc][to] ^ __cu_zobrist_psq[newPc][to];
+            polyglotKey ^= __polyglot_psq_key(pc, to) ^ __polyglot_psq_key(newPc, to);
             stack->materialKey ^= __cu_zobrist_psq[newPc][board_count_piece(board, newPc) - 1];
             stack->materialKey ^= __cu_zobrist_psq[pc][board_count_piece(board, pc)];
         }
@@ -742,31 +1112,19 @@ int board_push(Board *board, move_t move, Boardstack *stack) {
 
     stack->capturedPiece = captured;
     stack->key = key;
+    stack->polyglotKey = polyglotKey;
     stack->checkers = givesCheck ? board_attackers(board, board_king_square(board, them), us) : 0;
+    stack->checkInfo = 0;
     board->sideToMove = flip_color(board->sideToMove);
 
-    __board_set_check(board, stack);
-
-    stack->repetition = 0;
-
-    int repetitionPlies = __cu_min(board->stack->rule50, board->stack->lastNullmove);
-    Boardstack *stackIt = stack->prev->prev;
-
-    for (int i = 4; i <= repetitionPlies; i += 2) {
-        stackIt = stackIt->prev->prev;
-
-        if (stackIt->key == stack->key) {
-            board->stack->repetition = stackIt->repetition + 1;
-            break ;
-        }
-    }
+    stack->repetition = __board_record_key(board);
 
     return 0;
 }
 
 int board_push_nullmove(Board *board, Boardstack *stack) {
     if (board->internalStackAllocator) {
-        stack = malloc(sizeof(Boardstack));
+        stack = __board_alloc_stack(board);
 
         if (stack == NULL) {
             board_set_error(board, "Out of memory");
@@ -781,17 +1139,21 @@ int board_push_nullmove(Board *board, Boardstack *stack) {
 
     if (stack->enPassantSq != SQ_NONE) {
         stack->key ^= __cu_zobrist_ep[square_file(board->stack->enPassantSq)];
+        stack->polyglotKey ^= __polyglot_ep_key(board->stack->enPassantSq);
         stack->enPassantSq = SQ_NONE;
     }
 
     stack->key ^= __cu_zobrist_turn;
+    stack->polyglotKey ^= __cu_polyglot_random[CU_POLYGLOT_TURN_OFFSET];
+    stack->polyglotEP = SQ_NONE;
     ++stack->rule50;
     stack->lastNullmove = 0;
     board->sideToMove = flip_color(board->sideToMove);
 
-    __board_set_check(board, stack);
+    // Pieces didn't move, so only the check squares need to be recomputed.
+    stack->checkInfo &= ~CHECKINFO_SQUARES;
 
-    stack->repetition = 0;
+    stack->repetition = __board_record_key(board);
 
     return 0;
 }
@@ -799,12 +1161,15 @@ int board_push_nullmove(Board *board, Boardstack *stack) {
 move_t board_pop(Board *board) {
     Boardstack *last = board->stack;
 
+    --board->keyFilter[__board_key_filter_index(last->key)];
+    --board->historyPly;
+
     board->stack = board->stack->prev;
     board->sideToMove = flip_color(board->sideToMove);
 
     if (last->lastMove == NULL_MOVE) {
         if (board->internalStackAllocator)
-            free(last);
+            __board_free_stack(board, last);
         return NULL_MOVE;
     }
 
@@ -844,7 +1209,7 @@ move_t board_pop(Board *board) {
     }
 
     if (board->internalStackAllocator)
-        free(last);
+        __board_free_stack(board, last);
 
     --board->gamePly;
     return move;
@@ -872,9 +1237,27 @@ move_t *board_peek_all_moves(Board *board) {
     return moves;
 }
 
-const char *board_to_fen(const Board *board) {
-    static char fenBuffer[128];
-    char *ptr = fenBuffer;
+// Writes the decimal representation of the given value, and returns a pointer
+// past the last written character.
+static char *__board_write_uint(char *ptr, unsigned int value) {
+    char digits[16];
+    int count = 0;
+
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (count)
+        *(ptr++) = digits[--count];
+
+    return ptr;
+}
+
+// Writes the FEN of the board to a buffer of at least CU_FEN_MAX_LENGTH bytes,
+// and returns its length.
+static size_t __board_write_fen(const Board *board, char *buf) {
+    char *ptr = buf;
 
     for (rank_t r = RANK_8; r <= RANK_8; --r) {
         for (file_t f = FILE_A; f <= FILE_H; ++f) {
@@ -923,11 +1306,293 @@ const char *board_to_fen(const Board *board) {
         *(ptr++) = '1' + square_rank(board->stack->enPassantSq);
     }
 
-    sprintf(ptr, " %d %d", board_rule50(board), 1 + (board_ply(board) - (board_turn(board) == BLACK)) / 2);
+    *(ptr++) = ' ';
+    ptr = __board_write_uint(ptr, board_rule50(board));
+    *(ptr++) = ' ';
+    ptr = __board_write_uint(ptr, board_move_number(board));
+    *ptr = '\0';
+
+    return ptr - buf;
+}
+
+size_t board_write_fen(const Board *board, char *buf, size_t len) {
+    char fenBuffer[CU_FEN_MAX_LENGTH];
+    size_t length;
+
+    if (len >= CU_FEN_MAX_LENGTH)
+        return __board_write_fen(board, buf);
+
+    length = __board_write_fen(board, fenBuffer);
+
+    if (length >= len)
+        return 0;
+
+    memcpy(buf, fenBuffer, length + 1);
+    return length;
+}
 
+size_t board_write_fen_batch(const Board *boards, size_t count, char *buf, size_t len, size_t *length) {
+    size_t written = 0, i;
+
+    for (i = 0; i < count; ++i) {
+        size_t fenLength = board_write_fen(&boards[i], buf + written, len - written);
+
+        // Keep room for the newline.
+        if (fenLength == 0 || written + fenLength + 1 >= len)
+            break ;
+
+        written += fenLength;
+        buf[written++] = '\n';
+    }
+
+    if (written < len)
+        buf[written] = '\0';
+
+    *length = written;
+    return i;
+}
+
+const char *board_to_fen(const Board *board) {
+    static char fenBuffer[CU_FEN_MAX_LENGTH];
+
+    __board_write_fen(board, fenBuffer);
     return fenBuffer;
 }
 
+// Returns the pieces of the given type, other than the one moving, which could
+// also legally reach the destination square of the given move.
+static bitboard_t __board_san_ambiguity(const Board *board, move_t move, piecetype_t pt) {
+    const color_t us = board_turn(board);
+    const square_t to = move_to(move);
+    bitboard_t others = attacks_bb(pt, to, board_occupancy_bb(board)) & board_piece_bb(board, us, pt);
+    bitboard_t pinned;
+
+    others &= ~square_bb(move_from(move));
+    pinned = others & board_check_blockers(board, us);
+
+    // Pinned pieces are rare, so we only run the full legality test on them.
+    while (pinned) {
+        square_t sq = bb_pop_first_square(&pinned);
+
+        if (!board_move_is_legal(board, create_move(sq, to, NORMAL_MOVE)))
+            others ^= square_bb(sq);
+    }
+
+    return others;
+}
+
+size_t board_move_to_san(Board *board, move_t move, char *buf, size_t len) {
+    char sanBuffer[CU_SAN_MAX_LENGTH];
+    char *ptr = sanBuffer;
+    const square_t from = move_from(move), to = move_to(move);
+    const piecetype_t pt = piece_type(board_piece_at(board, from));
+    size_t length;
+
+    if (move_type(move) == CASTLING) {
+        strcpy(ptr, to > from ? "O-O" : "O-O-O");
+        ptr += strlen(ptr);
+    }
+    else {
+        if (pt != PAWN) {
+            bitboard_t others = __board_san_ambiguity(board, move, pt);
+
+            *(ptr++) = " PNBRQK"[pt];
+
+            if (others && !(others & square_file_bb(from)))
+                *(ptr++) = 'a' + square_file(from);
+
+            else if (others && !(others & square_rank_bb(from)))
+                *(ptr++) = '1' + square_rank(from);
+
+            else if (others) {
+                *(ptr++) = 'a' + square_file(from);
+                *(ptr++) = '1' + square_rank(from);
+            }
+        }
+
+        if (board_is_capture(board, move)) {
+            if (pt == PAWN)
+                *(ptr++) = 'a' + square_file(from);
+            *(ptr++) = 'x';
+        }
+
+        *(ptr++) = 'a' + square_file(to);
+        *(ptr++) = '1' + square_rank(to);
+
+        if (move_type(move) == PROMOTION) {
+            *(ptr++) = '=';
+            *(ptr++) = " PNBRQK"[promotion_type(move)];
+        }
+    }
+
+    // Only moves giving check need to be played to know if they are mates.
+    if (board_move_gives_check(board, move)) {
+        Boardstack stack;
+
+        if (board_push(board, move, &stack))
+            return 0;
+
+        *(ptr++) = board_has_legal_move(board) ? '+' : '#';
+        board_pop(board);
+    }
+
+    *ptr = '\0';
+    length = ptr - sanBuffer;
+
+    if (length >= len)
+        return 0;
+
+    memcpy(buf, sanBuffer, length + 1);
+    return length;
+}
+
+// Returns the castling of the side to move for the given SAN, and stores the
+// end of its notation in end. Returns NO_CASTLING if the SAN doesn't start
+// with a castling notation.
+static castling_t __board_san_castling(const Board *board, const char *san, const char **end) {
+    const char zero = san[0];
+    castling_t castling;
+
+    if ((zero != 'O' && zero != '0') || san[1] != '-' || san[2] != zero)
+        return NO_CASTLING;
+
+    if (san[3] == '-' && san[4] == zero) {
+        castling = QUEENSIDE_CASTLING;
+        *end = san + 5;
+    }
+    else {
+        castling = KINGSIDE_CASTLING;
+        *end = san + 3;
+    }
+
+    return castling & castling_color_mask(board_turn(board));
+}
+
+// Returns the piece type for the given SAN piece letter, or NO_PIECETYPE if
+// the character isn't a piece letter.
+static piecetype_t __board_san_piecetype(char c) {
+    const char *pieceChar = c != '\0' ? strchr(" PNBRQK", c) : NULL;
+
+    return pieceChar != NULL ? (piecetype_t)(pieceChar - " PNBRQK") : NO_PIECETYPE;
+}
+
+// Checks if the given character ends the SAN part of a move.
+__CU_INLINE bool __board_san_is_end(char c) {
+    return c == '\0' || isspace((unsigned char)c) || strchr("+#!?", c) != NULL;
+}
+
+move_t board_san_to_move(const Board *board, const char *san) {
+    const color_t us = board_turn(board);
+    const char *end;
+    castling_t castling = __board_san_castling(board, san, &end);
+    move_t move;
+
+    if (castling != NO_CASTLING) {
+        if (!__board_san_is_end(*end) || !(board->stack->castlingRights & castling))
+            return NO_MOVE;
+
+        move = create_move(board_king_square(board, us), board->castlingRookSquare[castling], CASTLING);
+
+        return board_move_is_pseudo_legal(board, move) && board_move_is_legal(board, move) ? move : NO_MOVE;
+    }
+
+    piecetype_t pt = __board_san_piecetype(san[0]), promotion = NO_PIECETYPE;
+    char coords[4];
+    int coordCount = 0;
+    bool capture = false;
+
+    if (pt == NO_PIECETYPE)
+        pt = PAWN;
+    else
+        ++san;
+
+    // Collect the source and destination coordinates, skipping capture marks.
+    for (; !__board_san_is_end(*san) && *san != '='; ++san) {
+        if (*san == 'x')
+            capture = true;
+
+        else if (coordCount < 4 && ((*san >= 'a' && *san <= 'h') || (*san >= '1' && *san <= '8')))
+            coords[coordCount++] = *san;
+
+        else
+            break ;
+    }
+
+    if (*san == '=')
+        ++san;
+
+    if (pt == PAWN && !__board_san_is_end(*san)) {
+        promotion = __board_san_piecetype(*san);
+
+        if (promotion < KNIGHT || promotion > QUEEN)
+            return NO_MOVE;
+        ++san;
+    }
+
+    if (!__board_san_is_end(*san) || coordCount < 2)
+        return NO_MOVE;
+
+    const char destFile = coords[coordCount - 2], destRank = coords[coordCount - 1];
+
+    if (destFile < 'a' || destFile > 'h' || destRank < '1' || destRank > '8')
+        return NO_MOVE;
+
+    const square_t to = create_square(destFile - 'a', destRank - '1');
+    bitboard_t fromMask = ~(bitboard_t)0;
+    bitboard_t candidates;
+
+    // The source hint is a file, a rank, or both in that order.
+    for (int i = 0; i < coordCount - 2; ++i) {
+        if (coords[i] >= 'a' && coords[i] <= 'h' && i == 0)
+            fromMask &= file_bb(coords[i] - 'a');
+
+        else if (coords[i] >= '1' && coords[i] <= '8' && i == coordCount - 3)
+            fromMask &= rank_bb(coords[i] - '1');
+
+        else
+            return NO_MOVE;
+    }
+
+    if (pt != PAWN)
+        candidates = attacks_bb(pt, to, board_occupancy_bb(board));
+
+    else if (capture || fromMask != ~(bitboard_t)0)
+        candidates = pawn_moves_bb(to, flip_color(us));
+
+    else if (relative_square_rank(to, us) < RANK_3)
+        return NO_MOVE;
+
+    else {
+        square_t pushSq = to - pawn_direction(us);
+
+        candidates = square_bb(pushSq);
+
+        if (board_is_empty(board, pushSq) && relative_square_rank(to, us) == RANK_4)
+            candidates |= square_bb(pushSq - pawn_direction(us));
+    }
+
+    candidates &= board_piece_bb(board, us, pt) & fromMask;
+    move = NO_MOVE;
+
+    while (candidates) {
+        square_t from = bb_pop_first_square(&candidates);
+        move_t candidate = promotion != NO_PIECETYPE ? create_promotion(from, to, promotion)
+            : pt == PAWN && to == board->stack->enPassantSq ? create_move(from, to, EN_PASSANT)
+            : create_move(from, to, NORMAL_MOVE);
+
+        if (!board_move_is_pseudo_legal(board, candidate) || !board_move_is_legal(board, candidate))
+            continue ;
+
+        // Two legal moves match the SAN, so it is ambiguous.
+        if (move != NO_MOVE)
+            return NO_MOVE;
+
+        move = candidate;
+    }
+
+    return move;
+}
+
 bool board_is_irreversible(const Board *board, move_t move) {
 
     // All promotions, castling moves and en-passant captures are irreversible.
@@ -979,3 +1644,177 @@ bitboard_t board_attackers(const Board *board, square_t sq, color_t c) {
          | (rook_moves_bb(sq, board_occupancy_bb(board)) & board_pieces_bb(board, c, ROOK, QUEEN))
          | (king_moves_bb(sq) & board_piece_bb(board, c, KING));
 }
+
+// Piece values for the static exchange evaluation. The King gets a value
+// high enough to never be traded.
+static const int __board_see_values[PIECETYPE_NB] = {
+    0, SEE_PAWN_VALUE, SEE_KNIGHT_VALUE, SEE_BISHOP_VALUE, SEE_ROOK_VALUE, SEE_QUEEN_VALUE, 20000, 0
+};
+
+// Gets the bitboard of attackers of both colors for the given square, with the
+// given occupancy.
+static bitboard_t __board_see_attackers(const Board *board, square_t sq, bitboard_t occupancy) {
+    return (pawn_moves_bb(sq, BLACK) & board_piece_bb(board, WHITE, PAWN))
+         | (pawn_moves_bb(sq, WHITE) & board_piece_bb(board, BLACK, PAWN))
+         | (knight_moves_bb(sq) & board_piecetype_bb(board, KNIGHT))
+         | (bishop_moves_bb(sq, occupancy) & board_piecetypes_bb(board, BISHOP, QUEEN))
+         | (rook_moves_bb(sq, occupancy) & board_piecetypes_bb(board, ROOK, QUEEN))
+         | (king_moves_bb(sq) & board_piecetype_bb(board, KING));
+}
+
+// Returns the attackers of the given color which can take part in the exchange.
+// Pinned pieces cannot, as long as one of their pinners is still on the board.
+__CU_INLINE bitboard_t __board_see_stm_attackers(const Board *board, bitboard_t attackers, bitboard_t occupancy, color_t stm) {
+    bitboard_t stmAttackers = attackers & board_color_bb(board, stm);
+
+    if (stmAttackers && (board_check_pinners(board, flip_color(stm)) & occupancy))
+        stmAttackers &= ~board_check_blockers(board, stm);
+
+    return stmAttackers;
+}
+
+// Removes the least valuable attacker from the occupancy, adds the sliders
+// found behind it to the attackers, and returns its piecetype.
+__CU_INLINE piecetype_t __board_see_pop_attacker(const Board *board, bitboard_t stmAttackers,
+    square_t sq, bitboard_t *occupancy, bitboard_t *attackers) {
+    piecetype_t pt = PAWN;
+    bitboard_t bb;
+
+    while (!(bb = stmAttackers & board_piecetype_bb(board, pt)))
+        ++pt;
+
+    *occupancy ^= bb & -bb;
+
+    if (pt == PAWN || pt == BISHOP || pt == QUEEN)
+        *attackers |= bishop_moves_bb(sq, *occupancy) & board_piecetypes_bb(board, BISHOP, QUEEN);
+
+    if (pt == ROOK || pt == QUEEN)
+        *attackers |= rook_moves_bb(sq, *occupancy) & board_piecetypes_bb(board, ROOK, QUEEN);
+
+    *attackers &= *occupancy;
+    return pt;
+}
+
+// Returns the material gained by the move itself, and stores the value of the
+// piece left on the destination square in onSquare.
+__CU_INLINE int __board_see_initial_gain(const Board *board, move_t move, int *onSquare) {
+    piecetype_t moved = piece_type(board_piece_at(board, move_from(move)));
+    int gain = move_type(move) == EN_PASSANT ? SEE_PAWN_VALUE
+        : __board_see_values[piece_type(board_piece_at(board, move_to(move)))];
+
+    *onSquare = __board_see_values[moved];
+
+    if (move_type(move) == PROMOTION) {
+        *onSquare = __board_see_values[promotion_type(move)];
+        gain += *onSquare - SEE_PAWN_VALUE;
+    }
+
+    return gain;
+}
+
+// Returns the occupancy after the given move has been played, without the
+// moving piece, and stores the attackers of the destination square.
+__CU_INLINE bitboard_t __board_see_occupancy(const Board *board, move_t move, bitboard_t *attackers) {
+    square_t from = move_from(move), to = move_to(move);
+    bitboard_t occupancy = board_occupancy_bb(board) ^ square_bb(from) ^ square_bb(to);
+
+    if (move_type(move) == EN_PASSANT) {
+        square_t captureSq = to - pawn_direction(board_turn(board));
+
+        occupancy ^= square_bb(captureSq);
+    }
+
+    *attackers = __board_see_attackers(board, to, occupancy) & occupancy;
+    return occupancy | square_bb(to);
+}
+
+int board_see(const Board *board, move_t move) {
+    if (move_type(move) == CASTLING)
+        return 0;
+
+    square_t to = move_to(move);
+    color_t stm = board_turn(board);
+    bitboard_t attackers;
+    bitboard_t occupancy = __board_see_occupancy(board, move, &attackers);
+    int gain[32];
+    int depth = 0;
+    int onSquare;
+
+    gain[0] = __board_see_initial_gain(board, move, &onSquare);
+
+    while (true) {
+        stm = flip_color(stm);
+
+        bitboard_t stmAttackers = __board_see_stm_attackers(board, attackers, occupancy, stm);
+
+        if (!stmAttackers)
+            break ;
+
+        piecetype_t pt = __board_see_pop_attacker(board, stmAttackers, to, &occupancy, &attackers);
+
+        // The King can only capture if the square is no longer defended.
+        if (pt == KING && (attackers & board_color_bb(board, flip_color(stm))))
+            break ;
+
+        ++depth;
+        gain[depth] = onSquare - gain[depth - 1];
+        onSquare = __board_see_values[pt];
+    }
+
+    // Each side can stop the exchange instead of recapturing.
+    while (depth) {
+        gain[depth - 1] = -__cu_max(-gain[depth - 1], gain[depth]);
+        --depth;
+    }
+
+    return gain[0];
+}
+
+bool board_see_ge(const Board *board, move_t move, int threshold) {
+    if (move_type(move) == CASTLING)
+        return threshold <= 0;
+
+    square_t to = move_to(move);
+    color_t stm = board_turn(board);
+    int onSquare;
+    int swap = __board_see_initial_gain(board, move, &onSquare) - threshold;
+
+    // The exchange fails even if the move is not recaptured.
+    if (swap < 0)
+        return false;
+
+    // The exchange succeeds even if the moved piece is lost for nothing.
+    swap = onSquare - swap;
+    if (swap <= 0)
+        return true;
+
+    bitboard_t attackers;
+    bitboard_t occupancy = __board_see_occupancy(board, move, &attackers);
+    bool result = true;
+
+    while (true) {
+        stm = flip_color(stm);
+
+        bitboard_t stmAttackers = __board_see_stm_attackers(board, attackers, occupancy, stm);
+
+        if (!stmAttackers)
+            break ;
+
+        piecetype_t pt = __board_see_pop_attacker(board, stmAttackers, to, &occupancy, &attackers);
+
+        // The King can only capture if the square is no longer defended, in
+        // which case the side capturing with it wins the exchange.
+        if (pt == KING)
+            return (attackers & board_color_bb(board, flip_color(stm))) ? result : !result;
+
+        result = !result;
+
+        // swap is now the balance from the point of view of the side which
+        // just captured, if its piece is taken back.
+        swap = __board_see_values[pt] - swap;
+        if (swap < (int)result)
+            break ;
+    }
+
+    return result;
+}
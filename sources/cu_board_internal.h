@@ -0,0 +1,56 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef __CU_BOARD_INTERNAL_H__
+#define __CU_BOARD_INTERNAL_H__
+
+// Private header shared by the sources setting up positions on a board. It is
+// not installed with the public headers.
+
+#include "cu_core.h"
+
+__CU_BEGIN_DECLS
+
+// Internal helpers for the functions setting up a position on a board.
+// __board_init() clears the board and its root stack (allocated internally if
+// stack is NULL), and __board_finish_init() completes the root stack once the
+// pieces, the side to move, the castling rights, the e.p. square and the move
+// counters are set. They return 0 if successful, a non-null value otherwise.
+int __board_init(Board *board, Boardstack *stack);
+int __board_set_castling(Board *board, color_t c, square_t rookSq);
+int __board_finish_init(Board *board);
+
+// Lighter variants for callers filling the whole board state themselves.
+// __board_init_root() only sets up the error, the stack allocator and the root
+// stack, without clearing anything else, and __board_finish_root() expects the
+// piece and material keys of the root stack to be set as well. They return 0
+// if successful, a non-null value otherwise.
+int __board_init_root(Board *board, Boardstack *stack);
+int __board_finish_root(Board *board);
+
+__CU_INLINE void __board_put_piece(Board *board, piece_t pc, square_t sq) {
+    board->table[sq] = pc;
+    board->piecetypeBBs[ALL_PIECES]     |= square_bb(sq);
+    board->piecetypeBBs[piece_type(pc)] |= square_bb(sq);
+    board->colorBBs[piece_color(pc)]    |= square_bb(sq);
+    board->pieceCounts[pc]++;
+    board->pieceCounts[create_piece(piece_color(pc), ALL_PIECES)]++;
+}
+
+__CU_END_DECLS
+
+#endif
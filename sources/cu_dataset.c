@@ -0,0 +1,198 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cu_dataset.h"
+
+_Static_assert(sizeof(DatasetRecord) == CU_PACKED_SIZE + CU_DATASET_PAYLOAD_SIZE, "DatasetRecord must not have padding");
+
+__CU_INLINE void __dataset_write_le(uint8_t *data, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i)
+        data[i] = (uint8_t)(value >> (8 * i));
+}
+
+__CU_INLINE uint64_t __dataset_read_le(const uint8_t *data, int bytes) {
+    uint64_t value = 0;
+
+    for (int i = 0; i < bytes; ++i)
+        value |= (uint64_t)data[i] << (8 * i);
+
+    return value;
+}
+
+__CU_INLINE size_t __dataset_record_size(int flags) {
+    return CU_PACKED_SIZE + ((flags & DATASET_PAYLOAD) ? CU_DATASET_PAYLOAD_SIZE : 0);
+}
+
+// Writes the header of the dataset at the current position of the file.
+static int __dataset_write_header(DatasetWriter *writer) {
+    uint8_t header[CU_DATASET_HEADER_SIZE] = {0};
+
+    memcpy(header, CU_DATASET_MAGIC, 8);
+    __dataset_write_le(header + 8, CU_DATASET_VERSION, 4);
+    __dataset_write_le(header + 12, __dataset_record_size(writer->flags), 4);
+    __dataset_write_le(header + 16, writer->count, 8);
+    __dataset_write_le(header + 24, (uint64_t)writer->flags, 4);
+
+    if (fwrite(header, CU_DATASET_HEADER_SIZE, 1, writer->file) != 1) {
+        strcpy(writer->err, "Cannot write dataset header");
+        return -1;
+    }
+
+    return 0;
+}
+
+int dataset_writer_open(DatasetWriter *writer, const char *path, int flags) {
+    memset(writer, 0, sizeof(DatasetWriter));
+    writer->flags = flags & DATASET_PAYLOAD;
+    writer->file = fopen(path, "wb");
+
+    if (writer->file == NULL) {
+        snprintf(writer->err, sizeof(writer->err), "Cannot create '%s'", path);
+        return -1;
+    }
+
+    // The record count is only known when closing the writer, so the header
+    // is written twice.
+    if (__dataset_write_header(writer)) {
+        fclose(writer->file);
+        writer->file = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int dataset_write(DatasetWriter *writer, const Board *board, int score, outcome_t outcome, move_t bestMove) {
+    DatasetRecord record;
+
+    if (board_pack(&record.position, board)) {
+        strcpy(writer->err, "Position cannot be packed");
+        return -1;
+    }
+
+    memset(record.payload, 0, CU_DATASET_PAYLOAD_SIZE);
+    __dataset_write_le(record.payload, (uint16_t)(int16_t)__cu_max(__cu_min(score, INT16_MAX), INT16_MIN), 2);
+    record.payload[2] = (uint8_t)outcome;
+    __dataset_write_le(record.payload + 4, bestMove, 2);
+
+    if (fwrite(&record, __dataset_record_size(writer->flags), 1, writer->file) != 1) {
+        strcpy(writer->err, "Cannot write dataset record");
+        return -1;
+    }
+
+    ++writer->count;
+    return 0;
+}
+
+int dataset_writer_close(DatasetWriter *writer) {
+    int ret = 0;
+
+    // Nothing to close if the writer failed to open, the error is already set.
+    if (writer->file == NULL)
+        return -1;
+
+    if (fseek(writer->file, 0, SEEK_SET)) {
+        strcpy(writer->err, "Cannot rewind dataset file");
+        ret = -1;
+    }
+    else if (__dataset_write_header(writer))
+        ret = -1;
+
+    if (fclose(writer->file) && !ret) {
+        strcpy(writer->err, "Cannot close dataset file");
+        ret = -1;
+    }
+
+    writer->file = NULL;
+    return ret;
+}
+
+int dataset_open(Dataset *dataset, const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    memset(dataset, 0, sizeof(Dataset));
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        snprintf(dataset->err, sizeof(dataset->err), "Cannot open '%s'", path);
+
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    if ((size_t)st.st_size < CU_DATASET_HEADER_SIZE) {
+        strcpy(dataset->err, "Truncated dataset header");
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        snprintf(dataset->err, sizeof(dataset->err), "Cannot map '%s'", path);
+        return -1;
+    }
+
+    dataset->data = data;
+    dataset->size = (size_t)st.st_size;
+
+    const uint8_t *header = dataset->data;
+
+    dataset->recordSize = (size_t)__dataset_read_le(header + 12, 4);
+    dataset->count = __dataset_read_le(header + 16, 8);
+    dataset->flags = (int)__dataset_read_le(header + 24, 4);
+
+    if (memcmp(header, CU_DATASET_MAGIC, 8))
+        strcpy(dataset->err, "Not a dataset file");
+
+    else if (__dataset_read_le(header + 8, 4) != CU_DATASET_VERSION)
+        strcpy(dataset->err, "Unsupported dataset version");
+
+    else if ((dataset->flags & ~DATASET_PAYLOAD) || dataset->recordSize != __dataset_record_size(dataset->flags))
+        strcpy(dataset->err, "Invalid dataset record format");
+
+    else if (dataset->count > (dataset->size - CU_DATASET_HEADER_SIZE) / dataset->recordSize)
+        strcpy(dataset->err, "Truncated dataset records");
+
+    else
+        return 0;
+
+    dataset_close(dataset);
+    return -1;
+}
+
+void dataset_close(Dataset *dataset) {
+    if (dataset->data)
+        munmap((void *)dataset->data, dataset->size);
+
+    dataset->data = NULL;
+    dataset->size = 0;
+    dataset->count = 0;
+}
+
+void dataset_iter_init(DatasetIterator *iter, const Dataset *dataset, uint64_t begin, uint64_t end) {
+    iter->dataset = dataset;
+    iter->end = end < dataset->count ? end : dataset->count;
+    iter->index = begin < iter->end ? begin : iter->end;
+}
@@ -0,0 +1,546 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cu_epd.h"
+
+// Minimal size of the chunk of file handled by a single thread.
+#define CU_EPD_CHUNK_SIZE 65536
+
+// Table of the pieces for each character of the piece section.
+static const piece_t __epd_pieces[256] = {
+    ['P'] = WHITE_PAWN, ['N'] = WHITE_KNIGHT, ['B'] = WHITE_BISHOP,
+    ['R'] = WHITE_ROOK, ['Q'] = WHITE_QUEEN,  ['K'] = WHITE_KING,
+    ['p'] = BLACK_PAWN, ['n'] = BLACK_KNIGHT, ['b'] = BLACK_BISHOP,
+    ['r'] = BLACK_ROOK, ['q'] = BLACK_QUEEN,  ['k'] = BLACK_KING
+};
+
+// Table of the empty square counts for each character of the piece section.
+static const uint8_t __epd_empty_squares[256] = {
+    ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+    ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8
+};
+
+// Table of the field separators. Newlines are handled by the line splitting.
+static const bool __epd_spaces[256] = {
+    [' '] = true, ['\t'] = true, ['\r'] = true
+};
+
+// Structure for the data of a single loader thread.
+typedef struct __EpdWorker_ {
+    pthread_t thread;
+    const char *begin;
+    const char *end;
+    size_t first;
+    size_t capacity;
+    Position *positions;
+    EpdOpcodes *opcodes;
+    size_t errorIndex;
+    const char *error;
+} __EpdWorker;
+
+__CU_INLINE bool __epd_is_space(char c) {
+    return __epd_spaces[(unsigned char)c];
+}
+
+__CU_INLINE const char *__epd_skip_spaces(const char *str, const char *end) {
+    while (str < end && __epd_is_space(*str))
+        ++str;
+
+    return str;
+}
+
+__CU_INLINE const char *__epd_skip_token(const char *str, const char *end) {
+    while (str < end && !__epd_is_space(*str))
+        ++str;
+
+    return str;
+}
+
+// Returns the end of the line starting at str, excluding the newline.
+__CU_INLINE const char *__epd_line_end(const char *str, const char *end) {
+    const char *newline = memchr(str, '\n', end - str);
+
+    return newline ? newline : end;
+}
+
+__CU_INLINE bool __epd_is_blank(const char *str, const char *end) {
+    return __epd_skip_spaces(str, end) == end;
+}
+
+// Parses an unsigned decimal integer spanning the whole token, saturated at
+// the given maximum. Returns -1 if the token isn't a number.
+static int __epd_parse_uint(const char *str, const char *end, int max) {
+    int value = 0;
+
+    if (str == end)
+        return -1;
+
+    for (; str < end; ++str) {
+        if (*str < '0' || *str > '9')
+            return -1;
+
+        int digit = *str - '0';
+
+        // Saturate before the multiplication can overflow.
+        value = value > (max - digit) / 10 ? max : value * 10 + digit;
+    }
+
+    return value;
+}
+
+// Parses the piece section of a record.
+static const char *__epd_parse_pieces(Position *pos, const char *str, const char *end) {
+    rank_t rank = RANK_8;
+    int file = 0;
+
+    for (; str < end; ++str) {
+        unsigned char c = (unsigned char)*str;
+
+        if (__epd_pieces[c]) {
+            if (file >= 8)
+                return "Too much squares on a single rank in piece section";
+
+            __position_put_piece(pos, __epd_pieces[c], create_square((file_t)file++, rank));
+        }
+
+        else if (__epd_empty_squares[c]) {
+            file += __epd_empty_squares[c];
+
+            if (file > 8)
+                return "Too much squares on a single rank in piece section";
+        }
+
+        else if (c == '/') {
+            if (file != 8)
+                return "Not enough squares on a single rank in piece section";
+
+            if (rank == RANK_1)
+                return "Too much ranks in piece section";
+
+            --rank;
+            file = 0;
+        }
+
+        else
+            return "Invalid character in piece section";
+    }
+
+    if (rank != RANK_1)
+        return "Missing ranks in piece section";
+
+    if (file != 8)
+        return "Not enough squares on a single rank in piece section";
+
+    bitboard_t whiteKing = position_piece_bb(pos, WHITE, KING);
+    bitboard_t blackKing = position_piece_bb(pos, BLACK, KING);
+
+    if (!whiteKing || more_than_one_bit(whiteKing) || !blackKing || more_than_one_bit(blackKing))
+        return "Invalid number of Kings on the board";
+
+    if (square_distance(position_king_square(pos, WHITE), position_king_square(pos, BLACK)) == 1)
+        return "Kings cannot touch each other";
+
+    return NULL;
+}
+
+// Parses the castling section of a record.
+static const char *__epd_parse_castling(Position *pos, const char *str, const char *end) {
+    if (end - str == 1 && *str == '-')
+        return NULL;
+
+    for (; str < end; ++str) {
+        color_t c = (*str >= 'a') ? BLACK : WHITE;
+        char castlingChar = (char)(*str & ~0x20);
+        square_t kingSq = position_king_square(pos, c);
+        bitboard_t rooks = position_piece_bb(pos, c, ROOK) & rank_bb(relative_rank(RANK_1, c));
+        square_t rookSq;
+
+        if (relative_square_rank(kingSq, c) != RANK_1)
+            return "Castling rights set with King not on back-rank";
+
+        if (castlingChar == 'K') {
+            rooks &= ~(square_bb(kingSq) - 1);
+            rookSq = rooks ? bb_last_square(rooks) : SQ_NONE;
+        }
+
+        else if (castlingChar == 'Q') {
+            rooks &= square_bb(kingSq) - 1;
+            rookSq = rooks ? bb_first_square(rooks) : SQ_NONE;
+        }
+
+        else if (castlingChar >= 'A' && castlingChar <= 'H') {
+            rookSq = create_square((file_t)(castlingChar - 'A'), relative_rank(RANK_1, c));
+            rookSq = (rooks & square_bb(rookSq)) ? rookSq : SQ_NONE;
+        }
+
+        else
+            return "Invalid character in castling section";
+
+        if (rookSq == SQ_NONE)
+            return "No Rook found for castling";
+
+        castling_t castling = castling_color_mask(c)
+            & (kingSq < rookSq ? KINGSIDE_CASTLING : QUEENSIDE_CASTLING);
+
+        pos->castlingRights |= castling;
+        pos->castlingRookSquare[bb_first_square(castling)] = rookSq;
+    }
+
+    return NULL;
+}
+
+// Parses the e.p. section of a record. The square is only kept if a pawn can
+// capture on it, like board_from_fen() does.
+static const char *__epd_parse_en_passant(Position *pos, const char *str, const char *end) {
+    color_t us = pos->sideToMove, them = flip_color(pos->sideToMove);
+
+    if (end - str == 1 && *str == '-')
+        return NULL;
+
+    if (end - str != 2)
+        return "Invalid e.p. square";
+
+    char fileChar = (char)(str[0] | 0x20);
+
+    if (fileChar < 'a' || fileChar > 'h' || str[1] != (us == WHITE ? '6' : '3'))
+        return "Invalid e.p. square";
+
+    square_t epSq = create_square((file_t)(fileChar - 'a'), (rank_t)(str[1] - '1'));
+
+    if (!(square_bb(epSq) & pawn_attacks_bb(position_piece_bb(pos, us, PAWN), us)))
+        return NULL;
+
+    if (!(position_piece_bb(pos, them, PAWN) & square_bb(epSq + pawn_direction(them))))
+        return "e.p. square set even though no pawn is present on the front square";
+
+    pos->enPassantSq = epSq;
+    return NULL;
+}
+
+// Parses the opcodes of a record, keeping the ones we know of.
+static const char *__epd_parse_opcodes(Position *pos, EpdOpcodes *opcodes, const char *str, const char *end) {
+    while ((str = __epd_skip_spaces(str, end)) < end) {
+        const char *opcode = str;
+        const char *opcodeEnd = str = __epd_skip_token(str, end);
+        bool quoted = false;
+
+        // Opcodes without operands carry nothing we keep.
+        if (opcodeEnd[-1] == ';')
+            continue ;
+
+        str = __epd_skip_spaces(str, end);
+
+        const char *operand = str;
+
+        // Operands end at the first semicolon outside of a string, or at the
+        // end of the line.
+        while (str < end && (quoted || *str != ';')) {
+            quoted ^= (*str == '"');
+            ++str;
+        }
+
+        const char *operandEnd = str;
+
+        while (operandEnd > operand && __epd_is_space(operandEnd[-1]))
+            --operandEnd;
+
+        if (operandEnd - operand >= 2 && *operand == '"' && operandEnd[-1] == '"')
+            ++operand, --operandEnd;
+
+        str += (str < end);
+
+        EpdSpan span = {operand, (size_t)(operandEnd - operand)};
+        size_t length = opcodeEnd - opcode;
+
+        if (length == 4 && !memcmp(opcode, "hmvc", 4)) {
+            int rule50 = __epd_parse_uint(operand, operandEnd, UINT8_MAX);
+
+            if (rule50 < 0)
+                return "Invalid hmvc operand";
+
+            pos->rule50 = (uint8_t)rule50;
+        }
+
+        else if (opcodes && length == 2 && !memcmp(opcode, "bm", 2))
+            opcodes->bm = span;
+
+        else if (opcodes && length == 2 && !memcmp(opcode, "id", 2))
+            opcodes->id = span;
+
+        else if (opcodes && length == 2 && !memcmp(opcode, "c0", 2))
+            opcodes->c0 = span;
+    }
+
+    return NULL;
+}
+
+// Computes the key and the checkers of a parsed position, and checks that the
+// side to move cannot capture the opponent King.
+static const char *__epd_finish_position(Position *pos) {
+    color_t us = pos->sideToMove, them = flip_color(pos->sideToMove);
+    bitboard_t occupancy = position_occupancy_bb(pos);
+
+    if (__position_attackers(pos, position_king_square(pos, them), us, occupancy))
+        return "Side to move can already capture the enemy King";
+
+    pos->checkers = __position_attackers(pos, position_king_square(pos, us), them, occupancy);
+
+    for (bitboard_t bb = occupancy; bb; ) {
+        square_t sq = bb_pop_first_square(&bb);
+
+        pos->key ^= __cu_zobrist_psq[position_piece_at(pos, sq)][sq];
+    }
+
+    if (pos->enPassantSq != SQ_NONE)
+        pos->key ^= __cu_zobrist_ep[square_file(pos->enPassantSq)];
+
+    if (us == BLACK)
+        pos->key ^= __cu_zobrist_turn;
+
+    pos->key ^= __cu_zobrist_castling[pos->castlingRights];
+    return NULL;
+}
+
+// Parses the record held by the line [str, end). Returns NULL if successful,
+// and an error string otherwise.
+static const char *__epd_parse_record(Position *pos, EpdOpcodes *opcodes, const char *str, const char *end) {
+    const char *error;
+    const char *token;
+
+    memset(pos, 0, sizeof(Position));
+    memset(pos->castlingRookSquare, SQ_NONE, sizeof(pos->castlingRookSquare));
+    pos->enPassantSq = SQ_NONE;
+
+    if (opcodes)
+        memset(opcodes, 0, sizeof(EpdOpcodes));
+
+    token = __epd_skip_spaces(str, end);
+    str = __epd_skip_token(token, end);
+
+    if ((error = __epd_parse_pieces(pos, token, str)) != NULL)
+        return error;
+
+    token = __epd_skip_spaces(str, end);
+    str = __epd_skip_token(token, end);
+
+    if (str - token != 1 || (*token != 'w' && *token != 'b'))
+        return "Invalid side to move section";
+
+    pos->sideToMove = (*token == 'b') ? BLACK : WHITE;
+
+    token = __epd_skip_spaces(str, end);
+    str = __epd_skip_token(token, end);
+
+    if (token == str || (error = __epd_parse_castling(pos, token, str)) != NULL)
+        return error ? error : "Missing castling section";
+
+    token = __epd_skip_spaces(str, end);
+    str = __epd_skip_token(token, end);
+
+    if (token == str || (error = __epd_parse_en_passant(pos, token, str)) != NULL)
+        return error ? error : "Missing e.p. section";
+
+    // Records copied from FENs may also have the move counters.
+    token = __epd_skip_spaces(str, end);
+    str = __epd_skip_token(token, end);
+
+    int rule50 = __epd_parse_uint(token, str, UINT8_MAX);
+
+    if (rule50 >= 0) {
+        pos->rule50 = (uint8_t)rule50;
+        token = __epd_skip_spaces(str, end);
+        str = __epd_skip_token(token, end);
+
+        if (__epd_parse_uint(token, str, INT32_MAX) < 0)
+            return "Invalid move number data";
+    }
+    else
+        str = token;
+
+    if ((error = __epd_parse_opcodes(pos, opcodes, str, end)) != NULL)
+        return error;
+
+    return __epd_finish_position(pos);
+}
+
+// Returns the number of records in [str, end).
+static size_t __epd_count_range(const char *str, const char *end) {
+    size_t count = 0;
+
+    while (str < end) {
+        const char *lineEnd = __epd_line_end(str, end);
+
+        count += !__epd_is_blank(str, lineEnd);
+        str = lineEnd + (lineEnd < end);
+    }
+
+    return count;
+}
+
+static void *__epd_worker(void *data) {
+    __EpdWorker *worker = data;
+    size_t index = worker->first;
+
+    for (const char *str = worker->begin; str < worker->end && index < worker->capacity; ) {
+        const char *lineEnd = __epd_line_end(str, worker->end);
+
+        if (!__epd_is_blank(str, lineEnd)) {
+            const char *error = __epd_parse_record(&worker->positions[index],
+                worker->opcodes ? &worker->opcodes[index] : NULL, str, lineEnd);
+
+            if (error) {
+                worker->errorIndex = index;
+                worker->error = error;
+                break ;
+            }
+
+            ++index;
+        }
+
+        str = lineEnd + (lineEnd < worker->end);
+    }
+
+    return NULL;
+}
+
+int epd_open(EpdFile *file, const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    memset(file, 0, sizeof(EpdFile));
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        snprintf(file->err, sizeof(file->err), "Cannot open '%s'", path);
+
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    file->size = (size_t)st.st_size;
+
+    // Empty files cannot be mapped, but are valid EPD files.
+    if (file->size) {
+        void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED) {
+            snprintf(file->err, sizeof(file->err), "Cannot map '%s'", path);
+            close(fd);
+            return -1;
+        }
+
+        madvise(data, file->size, MADV_SEQUENTIAL);
+        file->data = data;
+        file->mapped = true;
+    }
+
+    close(fd);
+    return 0;
+}
+
+void epd_open_buffer(EpdFile *file, const char *data, size_t size) {
+    memset(file, 0, sizeof(EpdFile));
+    file->data = data;
+    file->size = size;
+}
+
+void epd_close(EpdFile *file) {
+    if (file->mapped)
+        munmap((void *)file->data, file->size);
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = false;
+}
+
+size_t epd_count_records(const EpdFile *file) {
+    return __epd_count_range(file->data, file->data + file->size);
+}
+
+int epd_load(EpdFile *file, Position *positions, EpdOpcodes *opcodes, size_t capacity, size_t *count, int threads) {
+    const char *end = file->data + file->size;
+
+    threads = __cu_min(__cu_max(threads, 1), (int)__cu_min(file->size / CU_EPD_CHUNK_SIZE + 1, INT32_MAX));
+
+    __EpdWorker *workers = malloc(sizeof(__EpdWorker) * (size_t)threads);
+
+    if (workers == NULL) {
+        strcpy(file->err, "Out of memory");
+        return -2;
+    }
+
+    // Split the file in chunks of similar sizes, starting at line boundaries,
+    // and count their records to know where each chunk starts in the array.
+    const char *begin = file->data;
+    size_t first = 0;
+
+    for (int t = 0; t < threads; ++t) {
+        const char *chunkEnd = (t == threads - 1) ? end : file->data + file->size / threads * (t + 1);
+
+        if (chunkEnd < begin)
+            chunkEnd = begin;
+
+        if (chunkEnd < end) {
+            chunkEnd = __epd_line_end(chunkEnd, end);
+            chunkEnd += (chunkEnd < end);
+        }
+
+        workers[t] = (__EpdWorker){
+            .begin = begin, .end = chunkEnd, .first = first, .capacity = capacity,
+            .positions = positions, .opcodes = opcodes, .error = NULL
+        };
+
+        begin = workers[t].end;
+        first += (first < capacity) ? __epd_count_range(workers[t].begin, workers[t].end) : 0;
+    }
+
+    // The calling thread acts as the first worker. If a thread cannot be
+    // created, its chunk is parsed by the calling thread afterwards.
+    int started = 1;
+
+    while (started < threads && !pthread_create(&workers[started].thread, NULL, __epd_worker, &workers[started]))
+        ++started;
+
+    __epd_worker(&workers[0]);
+
+    for (int t = 1; t < threads; ++t) {
+        if (t < started)
+            pthread_join(workers[t].thread, NULL);
+        else
+            __epd_worker(&workers[t]);
+    }
+
+    *count = first < capacity ? first : capacity;
+
+    for (int t = 0; t < threads; ++t)
+        if (workers[t].error) {
+            snprintf(file->err, sizeof(file->err), "Record %zu: %s", workers[t].errorIndex, workers[t].error);
+            *count = workers[t].errorIndex;
+            free(workers);
+            return -1;
+        }
+
+    free(workers);
+    return 0;
+}
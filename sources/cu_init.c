@@ -17,6 +17,14 @@
 #include <string.h>
 #include "cu_core.h"
 
+const char *cu_get_version(void) {
+    return "1.0.2";
+}
+
+// When building with static tables, all the tables below are defined in the
+// generated cu_tables.c file instead (see the 'tables' Makefile target).
+#ifndef CU_STATIC_TABLES
+
 uint8_t __cu_square_distance[SQUARE_NB][SQUARE_NB];
 
 bitboard_t __cu_line_bb[SQUARE_NB][SQUARE_NB];
@@ -32,9 +40,46 @@ hashkey_t __cu_zobrist_ep[FILE_NB];
 hashkey_t __cu_zobrist_castling[CASTLING_NB];
 hashkey_t __cu_zobrist_turn;
 
-const char *cu_get_version(void) {
-    return "1.0.2";
-}
+// Precomputed magic numbers for Rook moves. (These are the magics that were
+// previously found at startup by a xorshift-based trial and error search.)
+static const bitboard_t __cu_rook_magic_numbers[SQUARE_NB] = {
+    0x0480002880104000, 0xC140001000A001C0, 0x1200081200408020, 0x4100041000090220,
+    0x0900080005009002, 0x0280040002008001, 0x0180068003000200, 0x8200108040240201,
+    0x6200800040008028, 0x0000C01000C02000, 0x0412002040108200, 0x0001800800D00080,
+    0x0005001100040800, 0x0628800200040180, 0x0104000102D00804, 0xB002002200588104,
+    0x4062828001204013, 0x100D020020804200, 0x0028110020010040, 0x0081010010040820,
+    0x9240050010080100, 0x0002808004000200, 0x00BC240010C10228, 0x0210020000608104,
+    0x2060400880002090, 0x88004000C0201000, 0x1010028280200010, 0x1415100100082100,
+    0x0230100500080101, 0x0204000202001008, 0x4801C20400102801, 0x1004004200208401,
+    0x0810204001801080, 0x0002448202002300, 0x000080D002802002, 0x5420082101001000,
+    0x0001910005000800, 0x404A000280800400, 0x8001002421000200, 0x0000008102000044,
+    0x0000308040008000, 0x0080810040010021, 0x1210080024002000, 0x1210008100080800,
+    0xA218000400808008, 0x0885040002008080, 0x4002820004010100, 0x0040004081220004,
+    0x0180408000210100, 0x0C20200888400880, 0x4006110820004100, 0x40E4082010010100,
+    0x0018800800040080, 0x6204020004008080, 0x0021004200044100, 0x8500204421008200,
+    0x0000411508608001, 0x1000D02280400501, 0x0800084020041101, 0x081600104024608A,
+    0x0009001002880005, 0x0851000400020801, 0x0420290208881044, 0x4002008044010022,
+};
+
+// Precomputed magic numbers for Bishop moves.
+static const bitboard_t __cu_bishop_magic_numbers[SQUARE_NB] = {
+    0x0820049010410020, 0x0020448082004801, 0x02E2082845800C00, 0x4062208604000014,
+    0x8501104000040011, 0x0020823040100002, 0x0084210802900000, 0x0000210908194000,
+    0x04000414840C4400, 0x1481050118090100, 0x4010212111020004, 0x0000042425804088,
+    0x0200011040400001, 0x0000089210402141, 0x80008200C2084000, 0x0088409601100240,
+    0x300800A002A40821, 0x380808101A048C20, 0x0240400880810100, 0x9208080286014040,
+    0x2852020412020200, 0x8401008808921014, 0x4414420401084900, 0x8080411202008400,
+    0x0002106040104220, 0x010D600008484310, 0x0404020004080010, 0x0101004084004200,
+    0x0001010004104006, 0x0010208011080108, 0x040224021A010120, 0x0000410200840100,
+    0x0428020980112000, 0x8041182010420464, 0x65C0109200900401, 0x00000401080C0100,
+    0x0089010400020220, 0x0302144501021000, 0x8002A80110004400, 0x0208008232088200,
+    0x4400908450012002, 0x0001082104085003, 0x0E01802808000D00, 0x40022C4200800801,
+    0x0900288B00400400, 0x004000C800400882, 0x4090090D11000400, 0x000414204A028040,
+    0x0820880110900010, 0x0000220202206020, 0x0180290C05144100, 0x08310A0042020006,
+    0x0020821202020005, 0x0022102001511000, 0x99202024C1004044, 0x001C081204302200,
+    0x648A404608014010, 0x1400002401041000, 0x0010000022011080, 0x0481080000208808,
+    0xE000409040482200, 0x0002080420148104, 0x4000040808410404, 0x0440100509212180,
+};
 
 // Computes the reachable squares from sq given the possible directions and
 // occupancy bits. (Note that we allow reaching an occupancy square as if it
@@ -54,28 +99,10 @@ static bitboard_t __cu_sliding_attack(const direction_t directions[4], square_t
     return attack;
 }
 
-// Initializes the magic bitboards for the given table and directions.
+// Initializes the magic bitboards for the given table, magic numbers and
+// directions.
 static void __cu_magic_init(bitboard_t *table, cu_magic_t *magics,
-                            const direction_t directions[4]) {
-    // To avoid compiler warnings.
-    int size = 0;
-
-    // The seed for the internal random number generator.
-    uint64_t xsSeed = 20650;
-
-    // Declare arrays out of the loop so that compilers don't have to deal
-    // with optimizing stack pointer operations.
-    bitboard_t occupancy[4096];
-    bitboard_t reachable[4096];
-
-    // The epoch is used to determine which iteration of the occupancy test
-    // we are in, to avoid zeroing the attack array between each failed
-    // iteration.
-    int epochTable[4096];
-    int currentEpoch = 0;
-
-    memset(epochTable, 0, sizeof(epochTable));
-
+                            const bitboard_t magicNumbers[SQUARE_NB], const direction_t directions[4]) {
     for (square_t sq = SQ_A1; sq <= SQ_H8; ++sq) {
 
         // The edges of the board are not counted in the occupancy bits
@@ -95,61 +122,22 @@ static void __cu_magic_init(bitboard_t *table, cu_magic_t *magics,
         // the occupancy, and 1 << popcount(mask) entries in the table
         // for storing the corresponding attack bitboards.
         mEntry->shift = 64 - popcount(mEntry->mask);
-
-        // We use the entry count of the previous square for having the
-        // next index.
-        mEntry->moves = (sq == SQ_A1) ? table : (mEntry - 1)->moves + size;
+        mEntry->magic = magicNumbers[sq];
+        mEntry->moves = table;
 
         bitboard_t iterBB = 0;
-        size = 0;
 
         // Iterate over all subsets of the occupancy mask with the
-        // Carry-Rippler trick and compute all attack bitboards for the current
+        // Carry-Rippler trick and store the attack bitboards for the current
         // square based on the occupancy.
         do {
-            occupancy[size] = iterBB;
-            reachable[size] = __cu_sliding_attack(directions, sq, iterBB);
-            ++size;
+            table[magic_index(mEntry, iterBB)] = __cu_sliding_attack(directions, sq, iterBB);
             iterBB = (iterBB - mEntry->mask) & mEntry->mask;
         } while (iterBB);
 
-        int i = 0;
-
-        // Now loop until we find a magic that maps each occupancy to a correct
-        // index in our magic table. We optimize the loop by using two binary
-        // ANDs to reduce the number of significant bits in the magic
-        // (good magics generally have high bit sparsity), and we reduce
-        // further the range of tested values by removing magics which do not
-        // generate enough significant bits for a full occupancy mask.
-        while (i < size) {
-            for (mEntry->magic = 0; popcount(mEntry->magic * mEntry->mask >> 56) < 6; ) {
-                mEntry->magic = cu_xorshift(&xsSeed);
-                mEntry->magic &= cu_xorshift(&xsSeed);
-                mEntry->magic &= cu_xorshift(&xsSeed);
-            }
-
-            // Check if the generated magic correctly maps each occupancy to
-            // its corresponding bitboard attack. Note that we build the table
-            // for the square as we test for each occupancy as a speedup, and
-            // that we allow two different occupancies to map to the same index
-            // if their corresponding bitboard attack is identical.
-            for (++currentEpoch, i = 0; i < size; ++i) {
-                unsigned int index = magic_index(mEntry, occupancy[i]);
-
-                // Check if we already wrote an attack bitboard at this index
-                // during this iteration of the loop. If not, we can set
-                // the attack bitboard corresponding to the occupancy at this
-                // index; otherwise we check if the attack bitboard already
-                // written is identical to the current one, and if it's not
-                // the case, the mapping failed, and we must try another value.
-                if (epochTable[index] != currentEpoch) {
-                    epochTable[index] = currentEpoch;
-                    mEntry->moves[index] = reachable[i];
-                }
-                else if (mEntry->moves[index] != reachable[i])
-                    break ;
-            }
-        }
+        // Use the entry count of the current square for having the next
+        // index.
+        table += (size_t)1 << popcount(mEntry->mask);
     }
 }
 
@@ -169,8 +157,8 @@ void cu_init(void) {
             __cu_square_distance[sq1][sq2] = __cu_max(file_distance(sq1, sq2), rank_distance(sq1, sq2));
 
     // Initialize the fancy magic bitboard tables.
-    __cu_magic_init(__cu_rook_mtable, __cu_rook_magics, __rook_dirs);
-    __cu_magic_init(__cu_bishop_mtable, __cu_bishop_magics, __bishop_dirs);
+    __cu_magic_init(__cu_rook_mtable, __cu_rook_magics, __cu_rook_magic_numbers, __rook_dirs);
+    __cu_magic_init(__cu_bishop_mtable, __cu_bishop_magics, __cu_bishop_magic_numbers, __bishop_dirs);
 
     // Initialize the pseudo-move bitboard tables, along with the line bitboard table.
     for (square_t sq = SQ_A1; sq <= SQ_H8; ++sq) {
@@ -226,3 +214,12 @@ void cu_init(void) {
     // Initialize the Zobrist turn value.
     __cu_zobrist_turn = cu_xorshift(&state);
 }
+
+#else
+
+void cu_init(void) {
+    // All tables are generated at build time, so there is nothing left to
+    // initialize.
+}
+
+#endif // CU_STATIC_TABLES
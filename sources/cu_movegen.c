@@ -14,6 +14,7 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <string.h>
 #include "cu_movegen.h"
 
 __CU_INLINE move_t *__mlist_gen_promotions(move_t *iter, square_t to, direction_t dir) {
@@ -25,9 +26,7 @@ __CU_INLINE move_t *__mlist_gen_promotions(move_t *iter, square_t to, direction_
     return iter;
 }
 
-__CU_INLINE move_t *__mlist_gen_piece_moves(move_t *iter, const Board *board, color_t us, piecetype_t pt, bitboard_t target) {
-    bitboard_t bb = board_piece_bb(board, us, pt);
-
+__CU_INLINE move_t *__mlist_gen_piece_moves(move_t *iter, const Board *board, piecetype_t pt, bitboard_t bb, bitboard_t target) {
     while (bb) {
         square_t from = bb_pop_first_square(&bb);
         bitboard_t toBB = attacks_bb(pt, from, board_occupancy_bb(board)) & target;
@@ -39,90 +38,43 @@ __CU_INLINE move_t *__mlist_gen_piece_moves(move_t *iter, const Board *board, co
     return iter;
 }
 
-move_t *__mlist_gen_pawn_moves(move_t *iter, const Board *board, color_t us) {
+// Generates moves of the given type for the given Pawns, with arrival squares
+// restricted to the given target, which must not contain any of our pieces.
+// En-passant captures are generated separately.
+__CU_INLINE move_t *__mlist_gen_pawn_moves(move_t *iter, const Board *board, color_t us, bitboard_t pawnsBB,
+    bitboard_t target, gentype_t type) {
     direction_t pawnPush = pawn_direction(us);
 
-    bitboard_t rank7PawnsBB    = board_piece_bb(board, us, PAWN) & (us == WHITE ? RANK_7_BB : RANK_2_BB);
-    bitboard_t notRank7PawnsBB = board_piece_bb(board, us, PAWN) & ~rank7PawnsBB;
+    bitboard_t rank7PawnsBB    = pawnsBB & (us == WHITE ? RANK_7_BB : RANK_2_BB);
+    bitboard_t notRank7PawnsBB = pawnsBB & ~rank7PawnsBB;
     bitboard_t emptyBB         = ~board_occupancy_bb(board);
-    bitboard_t theirPiecesBB   = board_color_bb(board, flip_color(us));
-    bitboard_t pushBB          = bb_relative_shift_north(notRank7PawnsBB, us) & emptyBB;
-    bitboard_t push2BB         = bb_relative_shift_north(pushBB & (us == WHITE ? RANK_3_BB : RANK_6_BB), us) & emptyBB;
-
-    while (pushBB) {
-        square_t to = bb_pop_first_square(&pushBB);
-        *(iter++) = create_move(to - pawnPush, to, NORMAL_MOVE);
-    }
+    bitboard_t theirPiecesBB   = board_color_bb(board, flip_color(us)) & target;
 
-    while (push2BB) {
-        square_t to = bb_pop_first_square(&push2BB);
-        *(iter++) = create_move(to - pawnPush * 2, to, NORMAL_MOVE);
-    }
-
-    if (rank7PawnsBB) {
-        bitboard_t promoteBB = bb_relative_shift_north(rank7PawnsBB, us);
+    if (type != CAPTURES) {
+        bitboard_t pushBB  = bb_relative_shift_north(notRank7PawnsBB, us) & emptyBB;
+        bitboard_t push2BB = bb_relative_shift_north(pushBB & (us == WHITE ? RANK_3_BB : RANK_6_BB), us) & emptyBB;
 
-        for (bitboard_t bb = promoteBB & emptyBB; bb; )
-            iter = __mlist_gen_promotions(iter, bb_pop_first_square(&bb), pawnPush);
+        pushBB  &= target;
+        push2BB &= target;
 
-        for (bitboard_t bb = bb_shift_west(promoteBB) & theirPiecesBB; bb; )
-            iter = __mlist_gen_promotions(iter, bb_pop_first_square(&bb), pawnPush + WEST);
+        while (pushBB) {
+            square_t to = bb_pop_first_square(&pushBB);
+            *(iter++) = create_move(to - pawnPush, to, NORMAL_MOVE);
+        }
 
-        for (bitboard_t bb = bb_shift_east(promoteBB) & theirPiecesBB; bb; )
-            iter = __mlist_gen_promotions(iter, bb_pop_first_square(&bb), pawnPush + EAST);
+        while (push2BB) {
+            square_t to = bb_pop_first_square(&push2BB);
+            *(iter++) = create_move(to - pawnPush * 2, to, NORMAL_MOVE);
+        }
     }
 
-    bitboard_t captureBB = bb_relative_shift_north(notRank7PawnsBB, us);
-
-    for (bitboard_t bb = bb_shift_west(captureBB) & theirPiecesBB; bb; ) {
-        square_t to = bb_pop_first_square(&bb);
-        *(iter++) = create_move(to - pawnPush - WEST, to, NORMAL_MOVE);
-    }
-
-    for (bitboard_t bb = bb_shift_east(captureBB) & theirPiecesBB; bb; ) {
-        square_t to = bb_pop_first_square(&bb);
-        *(iter++) = create_move(to - pawnPush - EAST, to, NORMAL_MOVE);
-    }
-
-    if (board->stack->enPassantSq != SQ_NONE) {
-        bitboard_t captureEpBB = notRank7PawnsBB & pawn_moves_bb(board->stack->enPassantSq, flip_color(us));
-
-        while (captureEpBB)
-            *(iter++) = create_move(bb_pop_first_square(&captureEpBB), board->stack->enPassantSq, EN_PASSANT);
-    }
-
-    return iter;
-}
-
-move_t *__mlist_gen_pawn_evasions(move_t *iter, const Board *board, bitboard_t blockSquares, color_t us) {
-    direction_t pawnPush = pawn_direction(us);
-
-    bitboard_t rank7PawnsBB    = board_piece_bb(board, us, PAWN) & (us == WHITE ? RANK_7_BB : RANK_2_BB);
-    bitboard_t notRank7PawnsBB = board_piece_bb(board, us, PAWN) & ~rank7PawnsBB;
-    bitboard_t emptyBB         = ~board_occupancy_bb(board);
-    bitboard_t theirPiecesBB   = board_color_bb(board, flip_color(us)) & blockSquares;
-    bitboard_t pushBB          = bb_relative_shift_north(notRank7PawnsBB, us) & emptyBB;
-    bitboard_t push2BB         = bb_relative_shift_north(pushBB & (us == WHITE ? RANK_3_BB : RANK_6_BB), us) & emptyBB;
-
-    pushBB  &= blockSquares;
-    push2BB &= blockSquares;
-
-    while (pushBB) {
-        square_t to = bb_pop_first_square(&pushBB);
-        *(iter++) = create_move(to - pawnPush, to, NORMAL_MOVE);
-    }
-
-    while (push2BB) {
-        square_t to = bb_pop_first_square(&push2BB);
-        *(iter++) = create_move(to - pawnPush * 2, to, NORMAL_MOVE);
-    }
+    if (type == QUIETS)
+        return iter;
 
     if (rank7PawnsBB) {
-        emptyBB &= blockSquares;
-
         bitboard_t promoteBB = bb_relative_shift_north(rank7PawnsBB, us);
 
-        for (bitboard_t bb = promoteBB & emptyBB; bb; )
+        for (bitboard_t bb = promoteBB & emptyBB & target; bb; )
             iter = __mlist_gen_promotions(iter, bb_pop_first_square(&bb), pawnPush);
 
         for (bitboard_t bb = bb_shift_west(promoteBB) & theirPiecesBB; bb; )
@@ -144,32 +96,49 @@ move_t *__mlist_gen_pawn_evasions(move_t *iter, const Board *board, bitboard_t b
         *(iter++) = create_move(to - pawnPush - EAST, to, NORMAL_MOVE);
     }
 
-    if (board->stack->enPassantSq != SQ_NONE) {
-        if (!(blockSquares & square_bb(board->stack->enPassantSq - pawnPush)))
-            return iter;
+    return iter;
+}
 
-        bitboard_t captureEpBB = notRank7PawnsBB & pawn_moves_bb(board->stack->enPassantSq, flip_color(us));
+// Generates en-passant captures for the given Pawns. They are only generated
+// if the captured Pawn is part of the target (which matters for evasions,
+// where the only valid en-passant capture is the one removing the checking
+// Pawn).
+__CU_INLINE move_t *__mlist_gen_en_passant(move_t *iter, const Board *board, color_t us, bitboard_t pawnsBB, bitboard_t target) {
+    square_t epSq = board->stack->enPassantSq;
+
+    if (epSq != SQ_NONE && (target & square_bb(epSq - pawn_direction(us)))) {
+        bitboard_t captureEpBB = pawnsBB & pawn_moves_bb(epSq, flip_color(us));
 
         while (captureEpBB)
-            *(iter++) = create_move(bb_pop_first_square(&captureEpBB), board->stack->enPassantSq, EN_PASSANT);
+            *(iter++) = create_move(bb_pop_first_square(&captureEpBB), epSq, EN_PASSANT);
     }
 
     return iter;
 }
 
-move_t *__mlist_gen_moves(move_t *iter, const Board *board) {
+// Generates all pseudo-legal moves of the given type for a position where the
+// side to move is not in check.
+move_t *__mlist_gen_moves(move_t *iter, const Board *board, gentype_t type) {
     color_t us = board_turn(board);
-    bitboard_t target = ~board_color_bb(board, us);
     square_t kingSq = board_king_square(board, us);
+    bitboard_t target = type == CAPTURES ? board_color_bb(board, flip_color(us))
+        : type == QUIETS ? ~board_occupancy_bb(board)
+        : ~board_color_bb(board, us);
+
+    iter = __mlist_gen_pawn_moves(iter, board, us, board_piece_bb(board, us, PAWN), ~board_color_bb(board, us), type);
 
-    iter = __mlist_gen_pawn_moves(iter, board, us);
+    if (type != QUIETS)
+        iter = __mlist_gen_en_passant(iter, board, us, board_piece_bb(board, us, PAWN), ~board_color_bb(board, us));
 
     for (piecetype_t pt = KNIGHT; pt <= QUEEN; ++pt)
-        iter = __mlist_gen_piece_moves(iter, board, us, pt, target);
+        iter = __mlist_gen_piece_moves(iter, board, pt, board_piece_bb(board, us, pt), target);
 
     for (bitboard_t bb = king_moves_bb(kingSq) & target; bb; )
         *(iter++) = create_move(kingSq, bb_pop_first_square(&bb), NORMAL_MOVE);
 
+    if (type == CAPTURES)
+        return iter;
+
     castling_t kingside  = castling_color_mask(us) & KINGSIDE_CASTLING;
     castling_t queenside = castling_color_mask(us) & QUEENSIDE_CASTLING;
 
@@ -182,6 +151,8 @@ move_t *__mlist_gen_moves(move_t *iter, const Board *board) {
     return iter;
 }
 
+// Generates all pseudo-legal moves for a position where the side to move is
+// in check.
 move_t *__mlist_gen_evasions(move_t *iter, const Board *board) {
     color_t us = board_turn(board);
     square_t kingSq = board_king_square(board, us);
@@ -203,35 +174,497 @@ move_t *__mlist_gen_evasions(move_t *iter, const Board *board) {
     square_t checkSq = bb_first_square(board->stack->checkers);
     bitboard_t blockSquares = between_squares_bb(checkSq, kingSq) | square_bb(checkSq);
 
-    iter = __mlist_gen_pawn_evasions(iter, board, blockSquares, us);
+    iter = __mlist_gen_pawn_moves(iter, board, us, board_piece_bb(board, us, PAWN), blockSquares, EVASIONS);
+    iter = __mlist_gen_en_passant(iter, board, us, board_piece_bb(board, us, PAWN), blockSquares);
+
+    for (piecetype_t pt = KNIGHT; pt <= QUEEN; ++pt)
+        iter = __mlist_gen_piece_moves(iter, board, pt, board_piece_bb(board, us, pt), blockSquares);
+
+    return iter;
+}
+
+// Returns the bitboard of all squares attacked by the given side, using the
+// given occupancy for slider attacks.
+__CU_INLINE bitboard_t __mlist_attack_map(const Board *board, color_t c, bitboard_t occupancy) {
+    bitboard_t attacks = pawn_attacks_bb(board_piece_bb(board, c, PAWN), c)
+        | king_moves_bb(board_king_square(board, c));
+
+    for (bitboard_t bb = board_piece_bb(board, c, KNIGHT); bb; )
+        attacks |= knight_moves_bb(bb_pop_first_square(&bb));
+
+    for (bitboard_t bb = board_pieces_bb(board, c, BISHOP, QUEEN); bb; )
+        attacks |= bishop_moves_bb(bb_pop_first_square(&bb), occupancy);
+
+    for (bitboard_t bb = board_pieces_bb(board, c, ROOK, QUEEN); bb; )
+        attacks |= rook_moves_bb(bb_pop_first_square(&bb), occupancy);
+
+    return attacks;
+}
+
+// Tests if the given available castling is legal, given the squares attacked
+// by the opponent. The side to move must not be in check.
+__CU_INLINE bool __mlist_castling_is_legal(const Board *board, castling_t castling, bitboard_t attacked) {
+    color_t us = board_turn(board);
+    square_t kingSq = board_king_square(board, us);
+    square_t rookSq = board->castlingRookSquare[castling];
+    square_t kingTo = relative_square(castling & KINGSIDE_CASTLING ? SQ_G1 : SQ_C1, us);
+
+    if (attacked & (between_squares_bb(kingSq, kingTo) | square_bb(kingTo)))
+        return false;
+
+    // In Chess960, the castling Rook might be the only piece shielding the
+    // King's arrival square from an opponent Rook or Queen.
+    return !board->chess960
+        || !(rook_moves_bb(kingTo, board_occupancy_bb(board) ^ square_bb(rookSq))
+            & board_pieces_bb(board, flip_color(us), ROOK, QUEEN));
+}
+
+// Generates all legal moves directly, using check and pin information instead
+// of testing each generated move for legality.
+move_t *__mlist_gen_legal(move_t *iter, const Board *board) {
+    color_t us = board_turn(board), them = flip_color(board_turn(board));
+    square_t kingSq = board_king_square(board, us);
+    bitboard_t checkers = board->stack->checkers;
+    bitboard_t pinned = board_check_blockers(board, us) & board_color_bb(board, us);
+    bitboard_t pawnsBB = board_piece_bb(board, us, PAWN);
+
+    // Compute the squares attacked by the opponent with our King removed from
+    // the occupancy, so that the King cannot step back along a checking
+    // slider's line.
+    bitboard_t attacked = __mlist_attack_map(board, them, board_occupancy_bb(board) ^ square_bb(kingSq));
+
+    for (bitboard_t bb = king_moves_bb(kingSq) & ~board_color_bb(board, us) & ~attacked; bb; )
+        *(iter++) = create_move(kingSq, bb_pop_first_square(&bb), NORMAL_MOVE);
+
+    // If double check, only a King move can be played
+    if (more_than_one_bit(checkers))
+        return iter;
+
+    // When in check, other moves must capture the checking piece or block the
+    // check.
+    bitboard_t target = checkers
+        ? between_squares_bb(bb_first_square(checkers), kingSq) | checkers
+        : ~board_color_bb(board, us);
+
+    iter = __mlist_gen_pawn_moves(iter, board, us, pawnsBB & ~pinned, target, NON_EVASIONS);
+
+    for (piecetype_t pt = KNIGHT; pt <= QUEEN; ++pt)
+        iter = __mlist_gen_piece_moves(iter, board, pt, board_piece_bb(board, us, pt) & ~pinned, target);
+
+    // En-passant captures can uncover a check along the capture rank, so we
+    // test them with the full legality check. They are rare enough for this
+    // not to matter.
+    move_t *epStart = iter;
+
+    iter = __mlist_gen_en_passant(iter, board, us, pawnsBB, target);
+
+    for (move_t *it = epStart; it < iter; ) {
+        if (!board_move_is_legal(board, *it))
+            *it = *(--iter);
+        else
+            ++it;
+    }
+
+    // Pinned pieces can only move along the line between them and our King
+    // (which excludes Knights). Note that the blockers also include pieces
+    // hidden behind another slider on the same line, which can still resolve
+    // a check by capturing that slider.
+    for (bitboard_t bb = pinned & ~board_piecetype_bb(board, KNIGHT); bb; ) {
+        square_t from = bb_pop_first_square(&bb);
+        piecetype_t pt = piece_type(board_piece_at(board, from));
+        bitboard_t lineTarget = target & __cu_line_bb[kingSq][from];
+
+        iter = (pt == PAWN)
+            ? __mlist_gen_pawn_moves(iter, board, us, square_bb(from), lineTarget, NON_EVASIONS)
+            : __mlist_gen_piece_moves(iter, board, pt, square_bb(from), lineTarget);
+    }
+
+    if (checkers)
+        return iter;
+
+    castling_t kingside  = castling_color_mask(us) & KINGSIDE_CASTLING;
+    castling_t queenside = castling_color_mask(us) & QUEENSIDE_CASTLING;
+
+    if (!!(board->stack->castlingRights & kingside) && !board_castling_blocked(board, kingside)
+        && __mlist_castling_is_legal(board, kingside, attacked))
+        *(iter++) = create_move(kingSq, board->castlingRookSquare[kingside], CASTLING);
+
+    if (!!(board->stack->castlingRights & queenside) && !board_castling_blocked(board, queenside)
+        && __mlist_castling_is_legal(board, queenside, attacked))
+        *(iter++) = create_move(kingSq, board->castlingRookSquare[queenside], CASTLING);
+
+    return iter;
+}
+
+// Counts the moves __mlist_gen_pawn_moves() would generate for the given Pawns
+// with the NON_EVASIONS type, using popcounts of the arrival squares.
+__CU_INLINE size_t __mlist_count_pawn_moves(const Board *board, color_t us, bitboard_t pawnsBB, bitboard_t target) {
+    bitboard_t rank7PawnsBB    = pawnsBB & (us == WHITE ? RANK_7_BB : RANK_2_BB);
+    bitboard_t notRank7PawnsBB = pawnsBB & ~rank7PawnsBB;
+    bitboard_t emptyBB         = ~board_occupancy_bb(board);
+    bitboard_t theirPiecesBB   = board_color_bb(board, flip_color(us)) & target;
+
+    bitboard_t pushBB    = bb_relative_shift_north(notRank7PawnsBB, us) & emptyBB;
+    bitboard_t push2BB   = bb_relative_shift_north(pushBB & (us == WHITE ? RANK_3_BB : RANK_6_BB), us) & emptyBB;
+    bitboard_t captureBB = bb_relative_shift_north(notRank7PawnsBB, us);
+    bitboard_t promoteBB = bb_relative_shift_north(rank7PawnsBB, us);
+
+    return popcount(pushBB & target) + popcount(push2BB & target)
+        + popcount(bb_shift_west(captureBB) & theirPiecesBB)
+        + popcount(bb_shift_east(captureBB) & theirPiecesBB)
+        + 4 * (popcount(promoteBB & emptyBB & target)
+            + popcount(bb_shift_west(promoteBB) & theirPiecesBB)
+            + popcount(bb_shift_east(promoteBB) & theirPiecesBB));
+}
+
+// Counts the legal moves of the given position without encoding them, following
+// the same rules as __mlist_gen_legal(). If 'any' is set, returns as soon as a
+// legal move has been found. The King moves, which need the opponent's attack
+// map, are counted last since they're the most expensive ones.
+static size_t __mlist_count_legal(const Board *board, bool any) {
+    color_t us = board_turn(board), them = flip_color(board_turn(board));
+    square_t kingSq = board_king_square(board, us);
+    bitboard_t checkers = board->stack->checkers;
+    bitboard_t pinned = board_check_blockers(board, us) & board_color_bb(board, us);
+    bitboard_t pawnsBB = board_piece_bb(board, us, PAWN);
+    bitboard_t occupancy = board_occupancy_bb(board);
+    size_t count = 0;
+
+    if (!more_than_one_bit(checkers)) {
+        bitboard_t target = checkers
+            ? between_squares_bb(bb_first_square(checkers), kingSq) | checkers
+            : ~board_color_bb(board, us);
+
+        count += __mlist_count_pawn_moves(board, us, pawnsBB & ~pinned, target);
+
+        for (bitboard_t bb = board_color_bb(board, us) & ~(pawnsBB | pinned | square_bb(kingSq)); bb; ) {
+            square_t from = bb_pop_first_square(&bb);
+
+            count += popcount(attacks_bb(piece_type(board_piece_at(board, from)), from, occupancy) & target);
+        }
+
+        if (any && count)
+            return count;
+
+        square_t epSq = board->stack->enPassantSq;
+
+        if (epSq != SQ_NONE && (target & square_bb(epSq - pawn_direction(us))))
+            for (bitboard_t bb = pawnsBB & pawn_moves_bb(epSq, them); bb; )
+                count += board_move_is_legal(board, create_move(bb_pop_first_square(&bb), epSq, EN_PASSANT));
+
+        for (bitboard_t bb = pinned & ~board_piecetype_bb(board, KNIGHT); bb; ) {
+            square_t from = bb_pop_first_square(&bb);
+            piecetype_t pt = piece_type(board_piece_at(board, from));
+            bitboard_t lineTarget = target & __cu_line_bb[kingSq][from];
+
+            count += (pt == PAWN)
+                ? __mlist_count_pawn_moves(board, us, square_bb(from), lineTarget)
+                : (size_t)popcount(attacks_bb(pt, from, occupancy) & lineTarget);
+        }
 
+        if (any && count)
+            return count;
+    }
+
+    bitboard_t attacked = __mlist_attack_map(board, them, occupancy ^ square_bb(kingSq));
+
+    count += popcount(king_moves_bb(kingSq) & ~board_color_bb(board, us) & ~attacked);
+
+    if (checkers)
+        return count;
+
+    castling_t kingside  = castling_color_mask(us) & KINGSIDE_CASTLING;
+    castling_t queenside = castling_color_mask(us) & QUEENSIDE_CASTLING;
+
+    count += !!(board->stack->castlingRights & kingside) && !board_castling_blocked(board, kingside)
+        && __mlist_castling_is_legal(board, kingside, attacked);
+
+    count += !!(board->stack->castlingRights & queenside) && !board_castling_blocked(board, queenside)
+        && __mlist_castling_is_legal(board, queenside, attacked);
+
+    return count;
+}
+
+// Generates all pseudo-legal quiet moves giving check for a position where the
+// side to move is not in check.
+move_t *__mlist_gen_quiet_checks(move_t *iter, const Board *board) {
+    color_t us = board_turn(board), them = flip_color(board_turn(board));
+    square_t kingSq = board_king_square(board, us);
+    square_t theirKing = board_king_square(board, them);
+    bitboard_t emptyBB = ~board_occupancy_bb(board);
+    bitboard_t dcCandidates = board_check_blockers(board, them) & board_color_bb(board, us);
+
+    // Knight, Bishop, Rook and Queen moves can give a direct check by landing
+    // on a checking square, or a discovered check by leaving the line between
+    // the slider and the opponent King.
     for (piecetype_t pt = KNIGHT; pt <= QUEEN; ++pt)
-        iter = __mlist_gen_piece_moves(iter, board, us, pt, blockSquares);
+        for (bitboard_t bb = board_piece_bb(board, us, pt); bb; ) {
+            square_t from = bb_pop_first_square(&bb);
+            bitboard_t toBB = attacks_bb(pt, from, board_occupancy_bb(board)) & emptyBB;
+
+            toBB &= (dcCandidates & square_bb(from))
+                ? ~__cu_line_bb[from][theirKing] | board_check_squares(board, pt)
+                : board_check_squares(board, pt);
+
+            while (toBB)
+                *(iter++) = create_move(from, bb_pop_first_square(&toBB), NORMAL_MOVE);
+        }
+
+    move_t *start = iter;
+
+    // Pawn pushes, King moves and castling moves are few enough that we can
+    // simply filter them with board_move_gives_check().
+    iter = __mlist_gen_pawn_moves(iter, board, us, board_piece_bb(board, us, PAWN), ~board_color_bb(board, us), QUIETS);
+
+    if (dcCandidates & square_bb(kingSq))
+        for (bitboard_t bb = king_moves_bb(kingSq) & emptyBB & ~__cu_line_bb[kingSq][theirKing]; bb; )
+            *(iter++) = create_move(kingSq, bb_pop_first_square(&bb), NORMAL_MOVE);
+
+    castling_t kingside  = castling_color_mask(us) & KINGSIDE_CASTLING;
+    castling_t queenside = castling_color_mask(us) & QUEENSIDE_CASTLING;
+
+    if (!!(board->stack->castlingRights & kingside) && !board_castling_blocked(board, kingside))
+        *(iter++) = create_move(kingSq, board->castlingRookSquare[kingside], CASTLING);
+
+    if (!!(board->stack->castlingRights & queenside) && !board_castling_blocked(board, queenside))
+        *(iter++) = create_move(kingSq, board->castlingRookSquare[queenside], CASTLING);
+
+    for (move_t *it = start; it < iter; ) {
+        if (!board_move_gives_check(board, *it))
+            *it = *(--iter);
+        else
+            ++it;
+    }
 
     return iter;
 }
 
+// Generates all pseudo-legal moves of the given type.
+__CU_INLINE move_t *__mlist_gen(move_t *iter, const Board *board, gentype_t type) {
+    return type == EVASIONS ? __mlist_gen_evasions(iter, board)
+        : type == QUIET_CHECKS ? __mlist_gen_quiet_checks(iter, board)
+        : __mlist_gen_moves(iter, board, type);
+}
+
+void mlist_generate(Movelist *mlist, const Board *board, gentype_t type) {
+    mlist->end = __mlist_gen(mlist->moves, board, type);
+}
+
 void mlist_generate_pseudo_legal(Movelist *mlist, const Board *board) {
     mlist->end = board->stack->checkers
         ? __mlist_gen_evasions(mlist->moves, board)
-        : __mlist_gen_moves(mlist->moves, board);
+        : __mlist_gen_moves(mlist->moves, board, NON_EVASIONS);
+}
+
+// Tests if the given pseudo-legal move is legal, only running the full
+// legality check for moves which can possibly be illegal.
+__CU_INLINE bool __mlist_move_is_legal(const Board *board, move_t move, bitboard_t pinned, square_t kingSq) {
+    return !(pinned || move_from(move) == kingSq || move_type(move) == EN_PASSANT)
+        || board_move_is_legal(board, move);
 }
 
 void mlist_generate_legal(Movelist *mlist, const Board *board) {
+    mlist->end = __mlist_gen_legal(mlist->moves, board);
+}
+
+size_t board_count_legal_moves(const Board *board) {
+    return __mlist_count_legal(board, false);
+}
+
+bool board_has_legal_move(const Board *board) {
+    return __mlist_count_legal(board, true) != 0;
+}
+
+void smlist_generate(ScoredMovelist *smlist, const Board *board, gentype_t type) {
+    smlist->end = __mlist_gen(smlist->moves, board, type);
+    memset(smlist->scores, 0, sizeof(int) * smlist_size(smlist));
+}
+
+void smlist_score_mvv_lva(ScoredMovelist *smlist, const Board *board) {
+    for (const move_t *iter = smlist->moves; iter < smlist->end; ++iter) {
+        move_t move = *iter;
+        piecetype_t moved = piece_type(board_piece_at(board, move_from(move)));
+        piecetype_t captured = move_type(move) == EN_PASSANT ? PAWN
+            : move_type(move) == CASTLING ? NO_PIECETYPE
+            : piece_type(board_piece_at(board, move_to(move)));
+        int score = 8 * captured;
+
+        if (move_type(move) == PROMOTION)
+            score += 8 * promotion_type(move);
+
+        smlist->scores[iter - smlist->moves] = score ? score + KING - moved + 1 : 0;
+    }
+}
+
+void smlist_sort(ScoredMovelist *smlist) {
+    size_t size = smlist_size(smlist);
+
+    // Insertion sort, which is stable and fast for the small lists we have.
+    for (size_t i = 1; i < size; ++i) {
+        move_t move = smlist->moves[i];
+        int score = smlist->scores[i];
+        size_t j;
+
+        for (j = i; j > 0 && smlist->scores[j - 1] < score; --j) {
+            smlist->moves[j] = smlist->moves[j - 1];
+            smlist->scores[j] = smlist->scores[j - 1];
+        }
+
+        smlist->moves[j] = move;
+        smlist->scores[j] = score;
+    }
+}
+
+move_t *smlist_split_see(ScoredMovelist *smlist, const Board *board, int threshold) {
+    move_t badMoves[CU_MAX_MOVES];
+    int badScores[CU_MAX_MOVES];
+    size_t good = 0, bad = 0;
+
+    for (size_t i = 0; i < smlist_size(smlist); ++i) {
+        if (board_see_ge(board, smlist->moves[i], threshold)) {
+            smlist->moves[good] = smlist->moves[i];
+            smlist->scores[good++] = smlist->scores[i];
+        }
+        else {
+            badMoves[bad] = smlist->moves[i];
+            badScores[bad++] = smlist->scores[i];
+        }
+    }
+
+    memcpy(smlist->moves + good, badMoves, sizeof(move_t) * bad);
+    memcpy(smlist->scores + good, badScores, sizeof(int) * bad);
+    return smlist->moves + good;
+}
+
+// Stages of the move picker.
+enum {
+    MP_TT, MP_INIT_CAPTURES, MP_CAPTURES, MP_INIT_QUIETS, MP_QUIETS, MP_BAD_CAPTURES,
+    MP_EVASION_TT, MP_INIT_EVASIONS, MP_EVASIONS,
+    MP_END
+};
+
+// Tests if the transposition table move is legal in the picker's position.
+static bool __movepicker_tt_is_legal(const MovePicker *mp) {
+    return board_move_is_pseudo_legal(mp->board, mp->ttMove)
+        && __mlist_move_is_legal(mp->board, mp->ttMove, mp->pinned, mp->kingSq);
+}
+
+void movepicker_init(MovePicker *mp, const Board *board, move_t ttMove, const move_t killers[2]) {
     color_t us = board_turn(board);
-    bitboard_t pinned = board->stack->checkBlockers[us] & board_color_bb(board, us);
-    square_t kingSq = board_king_square(board, us);
-    move_t *iter = mlist->moves;
 
-    mlist->end = board->stack->checkers
-        ? __mlist_gen_evasions(mlist->moves, board)
-        : __mlist_gen_moves(mlist->moves, board);
+    mp->board = board;
+    mp->ttMove = is_valid_move(ttMove) ? ttMove : NO_MOVE;
+    mp->killers[0] = killers ? killers[0] : NO_MOVE;
+    mp->killers[1] = killers ? killers[1] : NO_MOVE;
+    mp->stage = board->stack->checkers ? MP_EVASION_TT : MP_TT;
+    mp->pinned = board_check_blockers(board, us) & board_color_bb(board, us);
+    mp->kingSq = board_king_square(board, us);
+    mp->cur = mp->endBad = mp->list.end = mp->list.moves;
+}
 
-    while (iter < mlist->end) {
-        if ((pinned || move_from(*iter) == kingSq || move_type(*iter) == EN_PASSANT)
-            && !board_move_is_legal(board, *iter))
-            *iter = *(--mlist->end);
-        else
-            ++iter;
+move_t movepicker_next(MovePicker *mp) {
+    switch (mp->stage) {
+        case MP_TT:
+        case MP_EVASION_TT:
+            ++mp->stage;
+
+            if (mp->ttMove != NO_MOVE) {
+                if (__movepicker_tt_is_legal(mp))
+                    return mp->ttMove;
+
+                mp->ttMove = NO_MOVE;
+            }
+
+            return movepicker_next(mp);
+
+        case MP_INIT_CAPTURES:
+            smlist_generate(&mp->list, mp->board, CAPTURES);
+            smlist_score_mvv_lva(&mp->list, mp->board);
+            mp->cur = smlist_begin(&mp->list);
+            ++mp->stage;
+            // fallthrough
+
+        case MP_CAPTURES:
+            while (mp->cur < smlist_end(&mp->list)) {
+                move_t move = smlist_pick_best(&mp->list, mp->cur++);
+
+                if (move == mp->ttMove || !__mlist_move_is_legal(mp->board, move, mp->pinned, mp->kingSq))
+                    continue ;
+
+                // Losing captures are kept at the start of the list, which is
+                // always behind the current move, for the last stage.
+                if (!board_see_ge(mp->board, move, 0)) {
+                    *(mp->endBad++) = move;
+                    continue ;
+                }
+
+                return move;
+            }
+
+            ++mp->stage;
+            // fallthrough
+
+        case MP_INIT_QUIETS:
+            mp->list.end = __mlist_gen_moves(mp->endBad, mp->board, QUIETS);
+            mp->cur = mp->endBad;
+
+            // Move the killers to the front of the quiet moves, if they are
+            // present in the list.
+            for (int i = 0; i < 2; ++i) {
+                if (mp->killers[i] == mp->ttMove || (i == 1 && mp->killers[1] == mp->killers[0]))
+                    continue ;
+
+                for (move_t *iter = mp->cur; iter < smlist_end(&mp->list); ++iter)
+                    if (*iter == mp->killers[i]) {
+                        *iter = *mp->cur;
+                        *(mp->cur++) = mp->killers[i];
+                        break ;
+                    }
+            }
+
+            mp->cur = mp->endBad;
+            ++mp->stage;
+            // fallthrough
+
+        case MP_QUIETS:
+            while (mp->cur < smlist_end(&mp->list)) {
+                move_t move = *(mp->cur++);
+
+                if (move != mp->ttMove && __mlist_move_is_legal(mp->board, move, mp->pinned, mp->kingSq))
+                    return move;
+            }
+
+            mp->cur = smlist_begin(&mp->list);
+            ++mp->stage;
+            // fallthrough
+
+        case MP_BAD_CAPTURES:
+            // These moves have already been checked for legality.
+            if (mp->cur < mp->endBad)
+                return *(mp->cur++);
+
+            mp->stage = MP_END;
+            return NO_MOVE;
+
+        case MP_INIT_EVASIONS:
+            smlist_generate(&mp->list, mp->board, EVASIONS);
+            smlist_score_mvv_lva(&mp->list, mp->board);
+            mp->cur = smlist_begin(&mp->list);
+            ++mp->stage;
+            // fallthrough
+
+        case MP_EVASIONS:
+            while (mp->cur < smlist_end(&mp->list)) {
+                move_t move = smlist_pick_best(&mp->list, mp->cur++);
+
+                if (move != mp->ttMove && __mlist_move_is_legal(mp->board, move, mp->pinned, mp->kingSq))
+                    return move;
+            }
+
+            mp->stage = MP_END;
+            return NO_MOVE;
+
+        default:
+            return NO_MOVE;
     }
 }
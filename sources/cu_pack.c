@@ -0,0 +1,156 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <string.h>
+#include "cu_board_internal.h"
+#include "cu_pack.h"
+#include "cu_polyglot.h"
+
+_Static_assert(sizeof(PackedBoard) == CU_PACKED_SIZE, "PackedBoard must not have padding");
+
+// Nibble of a Rook with a castling right, for the given color.
+#define CU_PACKED_CASTLING_ROOK(c) (7 + 8 * (c))
+
+__CU_INLINE void __pack_write_u64(uint8_t *data, uint64_t value) {
+    for (int i = 0; i < 8; ++i)
+        data[i] = (uint8_t)(value >> (8 * i));
+}
+
+__CU_INLINE uint64_t __pack_read_u64(const uint8_t *data) {
+    uint64_t value = 0;
+
+    for (int i = 0; i < 8; ++i)
+        value |= (uint64_t)data[i] << (8 * i);
+
+    return value;
+}
+
+int board_pack(PackedBoard *packed, const Board *board) {
+    bitboard_t occupancy = board_occupancy_bb(board);
+    uint8_t *data = packed->data;
+    int ply = __cu_min(board->gamePly, UINT16_MAX);
+
+    if (popcount(occupancy) > 32)
+        return -1;
+
+    memset(data, 0, CU_PACKED_SIZE);
+    __pack_write_u64(data, occupancy);
+
+    for (int i = 0; occupancy; ++i) {
+        square_t sq = bb_pop_first_square(&occupancy);
+        piece_t pc = board_piece_at(board, sq);
+
+        if (piece_type(pc) == ROOK && (board->stack->castlingRights & board->castlingMasks[sq]))
+            pc = CU_PACKED_CASTLING_ROOK(piece_color(pc));
+
+        data[8 + i / 2] |= pc << (4 * (i & 1));
+    }
+
+    data[24] = board->sideToMove;
+    data[25] = board->stack->enPassantSq;
+    data[26] = (uint8_t)__cu_min(board->stack->rule50, UINT8_MAX);
+    data[28] = (uint8_t)ply;
+    data[29] = (uint8_t)(ply >> 8);
+    return 0;
+}
+
+int board_unpack(Board *board, Boardstack *stack, const PackedBoard *packed) {
+    const uint8_t *data = packed->data;
+    bitboard_t occupancy = __pack_read_u64(data);
+    bitboard_t nibbleBBs[16] = {0};
+    int ret = __board_init_root(board, stack);
+
+    if (ret)
+        return ret;
+
+    if (popcount(occupancy) > 32) {
+        board_set_error(board, "Too many pieces in packed position");
+        return -1;
+    }
+
+    // Only clear the parts of the board read from the root position. The
+    // castling squares and paths are only read for the castling rights set
+    // below, and the lazy check info of the stack is flagged as missing.
+    stack = board->stack;
+    stack->key = stack->materialKey = stack->polyglotKey = 0;
+    memset(board->table, NO_PIECE, sizeof(board->table));
+    memset(board->pieceCounts, 0, sizeof(board->pieceCounts));
+    memset(board->castlingMasks, 0, sizeof(board->castlingMasks));
+
+    // Fill the piece table, the piece counts and the keys while decoding the
+    // nibbles, and gather the squares of each nibble for the bitboards.
+    bitboard_t squares = occupancy;
+
+    for (int i = 0; squares; ++i) {
+        square_t sq = bb_pop_first_square(&squares);
+        int nibble = (data[8 + i / 2] >> (4 * (i & 1))) & 0xF;
+        piece_t pc = (nibble & 7) == 7 ? create_piece(nibble >> 3, ROOK) : (piece_t)nibble;
+
+        if (piece_type(pc) == NO_PIECETYPE) {
+            board_set_error(board, "Invalid piece in packed position");
+            return -1;
+        }
+
+        nibbleBBs[nibble] |= square_bb(sq);
+        board->table[sq] = pc;
+        stack->key ^= __cu_zobrist_psq[pc][sq];
+        stack->polyglotKey ^= __polyglot_psq_key(pc, sq);
+        stack->materialKey ^= __cu_zobrist_psq[pc][board->pieceCounts[pc]++];
+    }
+
+    bitboard_t castlingRooks = nibbleBBs[CU_PACKED_CASTLING_ROOK(WHITE)] | nibbleBBs[CU_PACKED_CASTLING_ROOK(BLACK)];
+
+    nibbleBBs[WHITE_ROOK] |= nibbleBBs[CU_PACKED_CASTLING_ROOK(WHITE)];
+    nibbleBBs[BLACK_ROOK] |= nibbleBBs[CU_PACKED_CASTLING_ROOK(BLACK)];
+    board->piecetypeBBs[ALL_PIECES] = occupancy;
+    board->colorBBs[WHITE] = board->colorBBs[BLACK] = 0;
+
+    for (piecetype_t pt = PAWN; pt <= KING; ++pt) {
+        board->piecetypeBBs[pt] = nibbleBBs[create_piece(WHITE, pt)] | nibbleBBs[create_piece(BLACK, pt)];
+        board->colorBBs[WHITE] |= nibbleBBs[create_piece(WHITE, pt)];
+        board->colorBBs[BLACK] |= nibbleBBs[create_piece(BLACK, pt)];
+    }
+
+    board->pieceCounts[create_piece(WHITE, ALL_PIECES)] = popcount(board->colorBBs[WHITE]);
+    board->pieceCounts[create_piece(BLACK, ALL_PIECES)] = popcount(board->colorBBs[BLACK]);
+
+    if (board_count_piece(board, WHITE_KING) != 1 || board_count_piece(board, BLACK_KING) != 1) {
+        board_set_error(board, "Invalid number of Kings on the board");
+        return -1;
+    }
+
+    board->sideToMove = data[24] ? BLACK : WHITE;
+    board->chess960 = false;
+    board->gamePly = data[28] | (data[29] << 8);
+
+    stack->prev = NULL;
+    stack->rule50 = data[26];
+    stack->lastNullmove = 0;
+    stack->repetition = 0;
+    stack->lastMove = NO_MOVE;
+    stack->enPassantSq = stack->polyglotEP = data[25] < SQUARE_NB ? data[25] : SQ_NONE;
+    stack->castlingRights = NO_CASTLING;
+    stack->capturedPiece = NO_PIECE;
+
+    while (castlingRooks) {
+        square_t rookSq = bb_pop_first_square(&castlingRooks);
+
+        if (__board_set_castling(board, piece_color(board_piece_at(board, rookSq)), rookSq))
+            return -1;
+    }
+
+    return __board_finish_root(board);
+}
@@ -0,0 +1,284 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cu_movegen.h"
+#include "cu_perft.h"
+
+// Structure for a unit of work: a sequence of one or two moves from the root
+// position, to be searched at the remaining depth.
+typedef struct __PerftTask_ {
+    move_t moves[2];
+    int length;
+} __PerftTask;
+
+// Structure for the data shared by all perft threads.
+typedef struct __PerftShared_ {
+    const Board *board;
+    const move_t *history;
+    size_t historyLength;
+    const __PerftTask *tasks;
+    size_t taskCount;
+    atomic_size_t nextTask;
+    int depth;
+    PerftCache *cache;
+} __PerftShared;
+
+// Structure for the data of a single perft thread.
+typedef struct __PerftWorker_ {
+    pthread_t thread;
+    __PerftShared *shared;
+    Boardstack *stacks;
+    uint64_t nodes;
+} __PerftWorker;
+
+int perft_cache_init(PerftCache *cache, size_t megabytes) {
+    size_t size = 1;
+
+    while (size * 2 * sizeof(PerftCacheEntry) <= megabytes * 1024 * 1024)
+        size *= 2;
+
+    cache->entries = malloc(sizeof(PerftCacheEntry) * size);
+
+    if (cache->entries == NULL)
+        return -2;
+
+    cache->size = size;
+    perft_cache_clear(cache);
+    return 0;
+}
+
+void perft_cache_clear(PerftCache *cache) {
+    memset(cache->entries, 0, sizeof(PerftCacheEntry) * cache->size);
+}
+
+void perft_cache_destroy(PerftCache *cache) {
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->size = 0;
+}
+
+// Returns the cache entry for the given key and depth. The depth is mixed in
+// the index so that the subtrees of a position at different depths don't
+// evict each other.
+__CU_INLINE PerftCacheEntry *__perft_cache_entry(PerftCache *cache, hashkey_t key, int depth) {
+    return &cache->entries[(key ^ ((uint64_t)depth * UINT64_C(0x9E3779B97F4A7C15))) & (cache->size - 1)];
+}
+
+// Probes the cache for the given key and depth. Returns true and stores the
+// node count if a matching entry was found.
+__CU_INLINE bool __perft_cache_probe(PerftCache *cache, hashkey_t key, int depth, uint64_t *nodes) {
+    PerftCacheEntry *entry = __perft_cache_entry(cache, key, depth);
+    uint64_t check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+    uint64_t data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+
+    if ((check ^ data) != key || (int)(data & 0xFF) != depth)
+        return false;
+
+    *nodes = data >> 8;
+    return true;
+}
+
+// Stores the node count for the given key and depth in the cache, always
+// replacing the previous entry.
+__CU_INLINE void __perft_cache_store(PerftCache *cache, hashkey_t key, int depth, uint64_t nodes) {
+    PerftCacheEntry *entry = __perft_cache_entry(cache, key, depth);
+    uint64_t data = (nodes << 8) | (uint64_t)depth;
+
+    __atomic_store_n(&entry->check, key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->data, data, __ATOMIC_RELAXED);
+}
+
+static uint64_t __perft(Board *board, int depth, Boardstack *stacks, PerftCache *cache) {
+    if (depth == 0)
+        return 1;
+
+    if (depth == 1)
+        return board_count_legal_moves(board);
+
+    Movelist mlist;
+    uint64_t count = 0;
+
+    if (cache && __perft_cache_probe(cache, board_key(board), depth, &count))
+        return count;
+
+    mlist_generate_legal(&mlist, board);
+
+    for (move_t *iter = mlist_begin(&mlist); iter < mlist_end(&mlist); ++iter) {
+        board_push(board, *iter, stacks);
+        count += __perft(board, depth - 1, stacks + 1, cache);
+        board_pop(board);
+    }
+
+    if (cache)
+        __perft_cache_store(cache, board_key(board), depth, count);
+
+    return count;
+}
+
+static void *__perft_worker(void *data) {
+    __PerftWorker *worker = data;
+    __PerftShared *shared = worker->shared;
+    Boardstack *stacks = worker->stacks;
+    Board board;
+    size_t taskIndex;
+
+    // Rebuild the position of the shared board from its root, so that the
+    // thread never touches the stacks of the caller.
+    board_copy_root(&board, shared->board, stacks++);
+
+    for (size_t i = 0; i < shared->historyLength; ++i) {
+        if (shared->history[i] == NULL_MOVE)
+            board_push_nullmove(&board, stacks++);
+        else
+            board_push(&board, shared->history[i], stacks++);
+    }
+
+    while ((taskIndex = atomic_fetch_add(&shared->nextTask, 1)) < shared->taskCount) {
+        const __PerftTask *task = &shared->tasks[taskIndex];
+
+        for (int i = 0; i < task->length; ++i)
+            board_push(&board, task->moves[i], stacks + i);
+
+        worker->nodes += __perft(&board, shared->depth - task->length, stacks + task->length, shared->cache);
+
+        for (int i = 0; i < task->length; ++i)
+            board_pop(&board);
+    }
+
+    return NULL;
+}
+
+// Returns the number of moves played from the root position of the board.
+static size_t __perft_history_length(const Board *board) {
+    size_t length = 0;
+
+    for (const Boardstack *stack = board->stack; stack->prev; stack = stack->prev)
+        ++length;
+
+    return length;
+}
+
+size_t cu_perft_stack_count(const Board *board, int depth, int threads) {
+    return (size_t)__cu_max(threads, 1) * (__perft_history_length(board) + (size_t)__cu_max(depth, 0) + 1);
+}
+
+// Splits the tree of the board into tasks of one move, or of two moves if
+// depth allows it and there are enough threads to benefit from finer work
+// units. Returns the number of tasks written in the array.
+static size_t __perft_split(__PerftTask *tasks, const Board *board, int depth, int threads) {
+    Board copy = *board;
+    Movelist rootList;
+    Boardstack stack;
+    size_t taskCount = 0;
+
+    mlist_generate_legal(&rootList, board);
+
+    // The copy shares its stacks with the original board, so we must make sure
+    // board_push() and board_pop() won't allocate or free anything.
+    copy.internalStackAllocator = false;
+
+    for (move_t *iter = mlist_begin(&rootList); iter < mlist_end(&rootList); ++iter) {
+        if (depth < 3 || threads == 1) {
+            tasks[taskCount++] = (__PerftTask){{*iter, NO_MOVE}, 1};
+            continue ;
+        }
+
+        Movelist replyList;
+
+        board_push(&copy, *iter, &stack);
+        mlist_generate_legal(&replyList, &copy);
+        board_pop(&copy);
+
+        for (move_t *reply = mlist_begin(&replyList); reply < mlist_end(&replyList); ++reply)
+            tasks[taskCount++] = (__PerftTask){{*iter, *reply}, 2};
+    }
+
+    return taskCount;
+}
+
+int cu_perft(uint64_t *nodes, const Board *board, int depth, int threads, Boardstack *stacks, PerftCache *cache) {
+    if (depth <= 0) {
+        *nodes = 1;
+        return 0;
+    }
+
+    threads = __cu_max(threads, 1);
+
+    size_t historyLength = __perft_history_length(board);
+    size_t threadStackCount = historyLength + (size_t)depth + 1;
+    bool internalStacks = (stacks == NULL);
+    __PerftTask *tasks = malloc(sizeof(__PerftTask) * CU_MAX_MOVES * CU_MAX_MOVES);
+    move_t *history = malloc(sizeof(move_t) * (historyLength + 1));
+    __PerftWorker *workers = malloc(sizeof(__PerftWorker) * (size_t)threads);
+
+    if (internalStacks)
+        stacks = malloc(sizeof(Boardstack) * threadStackCount * (size_t)threads);
+
+    if (!tasks || !history || !workers || !stacks) {
+        if (internalStacks)
+            free(stacks);
+        free(workers);
+        free(history);
+        free(tasks);
+        return -2;
+    }
+
+    size_t i = historyLength;
+
+    for (const Boardstack *stack = board->stack; stack->prev; stack = stack->prev)
+        history[--i] = stack->lastMove;
+
+    __PerftShared shared = {
+        .board = board,
+        .history = history,
+        .historyLength = historyLength,
+        .tasks = tasks,
+        .taskCount = __perft_split(tasks, board, depth, threads),
+        .depth = depth,
+        .cache = cache
+    };
+
+    atomic_init(&shared.nextTask, 0);
+
+    // The calling thread acts as the first worker. If a thread cannot be
+    // created, the remaining ones simply take its share of the work.
+    int started = 1;
+
+    for (int t = 0; t < threads; ++t)
+        workers[t] = (__PerftWorker){.shared = &shared, .stacks = stacks + threadStackCount * t, .nodes = 0};
+
+    while (started < threads && !pthread_create(&workers[started].thread, NULL, __perft_worker, &workers[started]))
+        ++started;
+
+    __perft_worker(&workers[0]);
+    *nodes = workers[0].nodes;
+
+    for (int t = 1; t < started; ++t) {
+        pthread_join(workers[t].thread, NULL);
+        *nodes += workers[t].nodes;
+    }
+
+    if (internalStacks)
+        free(stacks);
+    free(workers);
+    free(history);
+    free(tasks);
+    return 0;
+}
@@ -0,0 +1,353 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <string.h>
+#include "cu_position.h"
+
+_Static_assert(sizeof(Position) == 128, "Position must fit in two cache lines");
+
+// Castling rook squares are indexed by the bit index of the castling right.
+__CU_INLINE int __position_castling_index(castling_t castling) {
+    return __cu_tzcnt(castling);
+}
+
+__CU_INLINE void __position_remove_piece(Position *pos, square_t sq) {
+    piece_t pc = position_piece_at(pos, sq);
+    bitboard_t bb = square_bb(sq);
+
+    pos->table[sq >> 1] &= ~(0xF << ((sq & 1) * 4));
+    pos->piecetypeBBs[ALL_PIECES] ^= bb;
+    pos->piecetypeBBs[piece_type(pc)] ^= bb;
+    pos->colorBBs[piece_color(pc)] ^= bb;
+}
+
+// Returns the castling rights lost by moving a piece from or to the given
+// square.
+__CU_INLINE castling_t __position_castling_mask(const Position *pos, square_t sq) {
+    castling_t mask = NO_CASTLING;
+
+    for (castling_t rights = pos->castlingRights; rights; rights &= rights - 1) {
+        castling_t castling = rights & -rights;
+        int index = __position_castling_index(castling);
+
+        if (pos->castlingRookSquare[index] == sq
+            || square_bb(sq) & position_piece_bb(pos, castling & WHITE_CASTLING ? WHITE : BLACK, KING))
+            mask |= castling;
+    }
+
+    return mask;
+}
+
+void position_from_board(Position *pos, const Board *board) {
+    memset(pos, 0, sizeof(Position));
+
+    for (bitboard_t bb = board_occupancy_bb(board); bb; ) {
+        square_t sq = bb_pop_first_square(&bb);
+        __position_put_piece(pos, board_piece_at(board, sq), sq);
+    }
+
+    pos->key = board_key(board);
+    pos->checkers = board_checkers(board);
+    pos->rule50 = __cu_min(board_rule50(board), UINT8_MAX);
+    pos->sideToMove = board_turn(board);
+    pos->castlingRights = board->stack->castlingRights;
+    pos->enPassantSq = board->stack->enPassantSq;
+
+    for (int i = 0; i < 4; ++i)
+        pos->castlingRookSquare[i] = (pos->castlingRights & (1 << i)) ? board->castlingRookSquare[1 << i] : SQ_NONE;
+}
+
+int position_from_fen(Position *pos, const char *fen) {
+    Board board;
+    Boardstack stack;
+
+    if (board_from_fen(&board, &stack, fen))
+        return -1;
+
+    position_from_board(pos, &board);
+    board_destroy(&board);
+    return 0;
+}
+
+void position_make_move(Position *dst, const Position *src, move_t move) {
+    color_t us = src->sideToMove, them = flip_color(src->sideToMove);
+    square_t from = move_from(move), to = move_to(move);
+    piece_t pc = position_piece_at(src, from);
+    piece_t captured = move_type(move) == EN_PASSANT ? create_piece(them, PAWN) : position_piece_at(src, to);
+    hashkey_t key = src->key ^ __cu_zobrist_turn;
+
+    *dst = *src;
+    dst->rule50 += (dst->rule50 < UINT8_MAX);
+    dst->enPassantSq = SQ_NONE;
+
+    if (src->enPassantSq != SQ_NONE)
+        key ^= __cu_zobrist_ep[square_file(src->enPassantSq)];
+
+    castling_t castling = src->castlingRights
+        ? __position_castling_mask(src, from) | __position_castling_mask(src, to)
+        : NO_CASTLING;
+
+    if (castling) {
+        key ^= __cu_zobrist_castling[dst->castlingRights];
+        dst->castlingRights &= ~castling;
+        key ^= __cu_zobrist_castling[dst->castlingRights];
+    }
+
+    if (move_type(move) == CASTLING) {
+        bool kingside = to > from;
+        square_t rookTo = relative_square(kingside ? SQ_F1 : SQ_D1, us);
+        square_t kingTo = relative_square(kingside ? SQ_G1 : SQ_C1, us);
+
+        __position_remove_piece(dst, from);
+        __position_remove_piece(dst, to);
+        __position_put_piece(dst, pc, kingTo);
+        __position_put_piece(dst, captured, rookTo);
+
+        key ^= __cu_zobrist_psq[pc][from] ^ __cu_zobrist_psq[pc][kingTo];
+        key ^= __cu_zobrist_psq[captured][to] ^ __cu_zobrist_psq[captured][rookTo];
+    }
+    else {
+        piece_t newPc = move_type(move) == PROMOTION ? create_piece(us, promotion_type(move)) : pc;
+
+        if (captured) {
+            square_t captureSq = move_type(move) == EN_PASSANT ? to - pawn_direction(us) : to;
+
+            __position_remove_piece(dst, captureSq);
+            key ^= __cu_zobrist_psq[captured][captureSq];
+            dst->rule50 = 0;
+        }
+
+        __position_remove_piece(dst, from);
+        __position_put_piece(dst, newPc, to);
+        key ^= __cu_zobrist_psq[pc][from] ^ __cu_zobrist_psq[newPc][to];
+
+        if (piece_type(pc) == PAWN) {
+            dst->rule50 = 0;
+
+            // Only set the en-passant square if an opponent Pawn can capture,
+            // the same way as board_push() does.
+            if ((to ^ from) == 16 && (pawn_moves_bb(to - pawn_direction(us), us) & position_piece_bb(dst, them, PAWN))) {
+                dst->enPassantSq = to - pawn_direction(us);
+                key ^= __cu_zobrist_ep[square_file(dst->enPassantSq)];
+            }
+        }
+    }
+
+    dst->key = key;
+    dst->sideToMove = them;
+    dst->checkers = __position_attackers(dst, position_king_square(dst, them), us, position_occupancy_bb(dst));
+}
+
+__CU_INLINE move_t *__position_gen_promotions(move_t *iter, square_t to, direction_t dir) {
+    *(iter++) = create_promotion(to - dir, to, KNIGHT);
+    *(iter++) = create_promotion(to - dir, to, BISHOP);
+    *(iter++) = create_promotion(to - dir, to, ROOK);
+    *(iter++) = create_promotion(to - dir, to, QUEEN);
+
+    return iter;
+}
+
+// Generates all Pawn moves except en-passant captures for the given Pawns,
+// with arrival squares restricted to the given target.
+__CU_INLINE move_t *__position_gen_pawn_moves(move_t *iter, const Position *pos, bitboard_t pawnsBB, bitboard_t target) {
+    color_t us = pos->sideToMove;
+    direction_t pawnPush = pawn_direction(us);
+
+    bitboard_t rank7PawnsBB    = pawnsBB & (us == WHITE ? RANK_7_BB : RANK_2_BB);
+    bitboard_t notRank7PawnsBB = pawnsBB & ~rank7PawnsBB;
+    bitboard_t emptyBB         = ~position_occupancy_bb(pos);
+    bitboard_t theirPiecesBB   = pos->colorBBs[flip_color(us)] & target;
+
+    bitboard_t pushBB  = bb_relative_shift_north(notRank7PawnsBB, us) & emptyBB;
+    bitboard_t push2BB = bb_relative_shift_north(pushBB & (us == WHITE ? RANK_3_BB : RANK_6_BB), us) & emptyBB;
+
+    for (bitboard_t bb = pushBB & target; bb; ) {
+        square_t to = bb_pop_first_square(&bb);
+        *(iter++) = create_move(to - pawnPush, to, NORMAL_MOVE);
+    }
+
+    for (bitboard_t bb = push2BB & target; bb; ) {
+        square_t to = bb_pop_first_square(&bb);
+        *(iter++) = create_move(to - pawnPush * 2, to, NORMAL_MOVE);
+    }
+
+    if (rank7PawnsBB) {
+        bitboard_t promoteBB = bb_relative_shift_north(rank7PawnsBB, us);
+
+        for (bitboard_t bb = promoteBB & emptyBB & target; bb; )
+            iter = __position_gen_promotions(iter, bb_pop_first_square(&bb), pawnPush);
+
+        for (bitboard_t bb = bb_shift_west(promoteBB) & theirPiecesBB; bb; )
+            iter = __position_gen_promotions(iter, bb_pop_first_square(&bb), pawnPush + WEST);
+
+        for (bitboard_t bb = bb_shift_east(promoteBB) & theirPiecesBB; bb; )
+            iter = __position_gen_promotions(iter, bb_pop_first_square(&bb), pawnPush + EAST);
+    }
+
+    bitboard_t captureBB = bb_relative_shift_north(notRank7PawnsBB, us);
+
+    for (bitboard_t bb = bb_shift_west(captureBB) & theirPiecesBB; bb; ) {
+        square_t to = bb_pop_first_square(&bb);
+        *(iter++) = create_move(to - pawnPush - WEST, to, NORMAL_MOVE);
+    }
+
+    for (bitboard_t bb = bb_shift_east(captureBB) & theirPiecesBB; bb; ) {
+        square_t to = bb_pop_first_square(&bb);
+        *(iter++) = create_move(to - pawnPush - EAST, to, NORMAL_MOVE);
+    }
+
+    return iter;
+}
+
+// Returns the bitboard of our pieces pinned to our King.
+__CU_INLINE bitboard_t __position_pinned(const Position *pos, color_t us, square_t kingSq) {
+    bitboard_t theirs = pos->colorBBs[flip_color(us)];
+    bitboard_t pinned = 0;
+    bitboard_t snipers = theirs & (
+            (__cu_pseudo_moves_bb[BISHOP][kingSq] & (pos->piecetypeBBs[BISHOP] | pos->piecetypeBBs[QUEEN]))
+          | (__cu_pseudo_moves_bb[ROOK  ][kingSq] & (pos->piecetypeBBs[ROOK  ] | pos->piecetypeBBs[QUEEN])));
+
+    while (snipers) {
+        bitboard_t between = between_squares_bb(bb_pop_first_square(&snipers), kingSq) & position_occupancy_bb(pos);
+
+        if (between && !more_than_one_bit(between))
+            pinned |= between & pos->colorBBs[us];
+    }
+
+    return pinned;
+}
+
+// Tests if the given en-passant capture leaves our King in check.
+__CU_INLINE bool __position_en_passant_is_legal(const Position *pos, square_t from, square_t to, square_t kingSq) {
+    bitboard_t theirs = pos->colorBBs[flip_color(pos->sideToMove)];
+    square_t captureSq = to - pawn_direction(pos->sideToMove);
+    bitboard_t occupancy = (position_occupancy_bb(pos) ^ square_bb(from) ^ square_bb(captureSq)) | square_bb(to);
+
+    return !(bishop_moves_bb(kingSq, occupancy) & theirs & (pos->piecetypeBBs[BISHOP] | pos->piecetypeBBs[QUEEN]))
+        && !(rook_moves_bb(kingSq, occupancy) & theirs & (pos->piecetypeBBs[ROOK] | pos->piecetypeBBs[QUEEN]));
+}
+
+// Returns the bitboard of all squares attacked by the given side, using the
+// given occupancy for slider attacks.
+__CU_INLINE bitboard_t __position_attack_map(const Position *pos, color_t c, bitboard_t occupancy) {
+    bitboard_t attacks = pawn_attacks_bb(position_piece_bb(pos, c, PAWN), c)
+        | king_moves_bb(position_king_square(pos, c));
+
+    for (bitboard_t bb = position_piece_bb(pos, c, KNIGHT); bb; )
+        attacks |= knight_moves_bb(bb_pop_first_square(&bb));
+
+    for (bitboard_t bb = pos->colorBBs[c] & (pos->piecetypeBBs[BISHOP] | pos->piecetypeBBs[QUEEN]); bb; )
+        attacks |= bishop_moves_bb(bb_pop_first_square(&bb), occupancy);
+
+    for (bitboard_t bb = pos->colorBBs[c] & (pos->piecetypeBBs[ROOK] | pos->piecetypeBBs[QUEEN]); bb; )
+        attacks |= rook_moves_bb(bb_pop_first_square(&bb), occupancy);
+
+    return attacks;
+}
+
+// Generates the given castling if it is legal. The side to move must not be
+// in check.
+__CU_INLINE move_t *__position_gen_castling(move_t *iter, const Position *pos, castling_t castling,
+    square_t kingSq, bitboard_t attacked) {
+    color_t us = pos->sideToMove;
+    square_t rookSq = pos->castlingRookSquare[__position_castling_index(castling)];
+    square_t kingTo = relative_square(castling & KINGSIDE_CASTLING ? SQ_G1 : SQ_C1, us);
+    square_t rookTo = relative_square(castling & KINGSIDE_CASTLING ? SQ_F1 : SQ_D1, us);
+    bitboard_t kingPath = between_squares_bb(kingSq, kingTo) | square_bb(kingTo);
+    bitboard_t path = (kingPath | between_squares_bb(rookSq, rookTo) | square_bb(rookTo))
+        & ~(square_bb(kingSq) | square_bb(rookSq));
+    bitboard_t theirs = pos->colorBBs[flip_color(us)];
+
+    if (!(pos->castlingRights & castling) || (path & position_occupancy_bb(pos)) || (kingPath & attacked))
+        return iter;
+
+    // The castling Rook might be the only piece shielding the King's arrival
+    // square from an opponent Rook or Queen (which can only happen in
+    // Chess960, but is cheap enough to always test).
+    if (rook_moves_bb(kingTo, position_occupancy_bb(pos) ^ square_bb(rookSq))
+        & theirs & (pos->piecetypeBBs[ROOK] | pos->piecetypeBBs[QUEEN]))
+        return iter;
+
+    *(iter++) = create_move(kingSq, rookSq, CASTLING);
+    return iter;
+}
+
+void position_generate_legal(Movelist *mlist, const Position *pos) {
+    color_t us = pos->sideToMove, them = flip_color(pos->sideToMove);
+    square_t kingSq = position_king_square(pos, us);
+    bitboard_t occupancy = position_occupancy_bb(pos);
+    bitboard_t checkers = pos->checkers;
+    bitboard_t pinned = __position_pinned(pos, us, kingSq);
+    bitboard_t pawnsBB = position_piece_bb(pos, us, PAWN);
+    bitboard_t attacked = __position_attack_map(pos, them, occupancy ^ square_bb(kingSq));
+    move_t *iter = mlist->moves;
+
+    for (bitboard_t bb = king_moves_bb(kingSq) & ~pos->colorBBs[us] & ~attacked; bb; )
+        *(iter++) = create_move(kingSq, bb_pop_first_square(&bb), NORMAL_MOVE);
+
+    // If double check, only a King move can be played
+    if (more_than_one_bit(checkers)) {
+        mlist->end = iter;
+        return ;
+    }
+
+    bitboard_t target = checkers
+        ? between_squares_bb(bb_first_square(checkers), kingSq) | checkers
+        : ~pos->colorBBs[us];
+
+    iter = __position_gen_pawn_moves(iter, pos, pawnsBB & ~pinned, target);
+
+    // Pinned Pawns can only move along the line between them and our King.
+    for (bitboard_t bb = pawnsBB & pinned; bb; ) {
+        square_t from = bb_pop_first_square(&bb);
+        iter = __position_gen_pawn_moves(iter, pos, square_bb(from), target & __cu_line_bb[kingSq][from]);
+    }
+
+    if (pos->enPassantSq != SQ_NONE && (target & square_bb(pos->enPassantSq - pawn_direction(us)))) {
+        for (bitboard_t bb = pawnsBB & pawn_moves_bb(pos->enPassantSq, them); bb; ) {
+            square_t from = bb_pop_first_square(&bb);
+
+            if (__position_en_passant_is_legal(pos, from, pos->enPassantSq, kingSq))
+                *(iter++) = create_move(from, pos->enPassantSq, EN_PASSANT);
+        }
+    }
+
+    for (piecetype_t pt = KNIGHT; pt <= QUEEN; ++pt)
+        for (bitboard_t bb = position_piece_bb(pos, us, pt) & ~pinned; bb; ) {
+            square_t from = bb_pop_first_square(&bb);
+
+            for (bitboard_t toBB = attacks_bb(pt, from, occupancy) & target; toBB; )
+                *(iter++) = create_move(from, bb_pop_first_square(&toBB), NORMAL_MOVE);
+        }
+
+    // Pinned Knights can never move, and other pinned pieces can only move
+    // along the line between them and our King.
+    for (bitboard_t bb = pinned & ~(pawnsBB | pos->piecetypeBBs[KNIGHT]); bb; ) {
+        square_t from = bb_pop_first_square(&bb);
+        bitboard_t toBB = attacks_bb(piece_type(position_piece_at(pos, from)), from, occupancy)
+            & target & __cu_line_bb[kingSq][from];
+
+        while (toBB)
+            *(iter++) = create_move(from, bb_pop_first_square(&toBB), NORMAL_MOVE);
+    }
+
+    if (!checkers && (pos->castlingRights & castling_color_mask(us))) {
+        iter = __position_gen_castling(iter, pos, castling_color_mask(us) & KINGSIDE_CASTLING, kingSq, attacked);
+        iter = __position_gen_castling(iter, pos, castling_color_mask(us) & QUEENSIDE_CASTLING, kingSq, attacked);
+    }
+
+    mlist->end = iter;
+}
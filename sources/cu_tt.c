@@ -0,0 +1,175 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "cu_tt.h"
+
+_Static_assert(sizeof(TTCluster) == 32, "TTCluster must be 32 bytes long");
+
+// Alignment of large tables, so that they can be backed by huge pages.
+#define CU_TT_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Structure for the data of a single clearing thread.
+typedef struct __TTClearWorker_ {
+    pthread_t thread;
+    TTCluster *begin;
+    size_t count;
+} __TTClearWorker;
+
+__CU_INLINE uint16_t __tt_key16(hashkey_t key) {
+    return (uint16_t)(key >> 48);
+}
+
+// Returns the age of the entry relative to the current generation, in
+// multiples of 8, handling the wrapping of the 8-bit generation counter.
+__CU_INLINE int __tt_relative_age(const TranspositionTable *tt, const TTEntry *entry) {
+    return (uint8_t)(tt->generation8 - (entry->genBound8 & 0xF8));
+}
+
+int tt_init(TranspositionTable *tt, size_t megabytes, int threads) {
+    size_t count = 2;
+
+    while (count * 2 * sizeof(TTCluster) <= megabytes * 1024 * 1024)
+        count *= 2;
+
+    size_t size = count * sizeof(TTCluster);
+    size_t alignment = size >= CU_TT_HUGE_PAGE_SIZE ? CU_TT_HUGE_PAGE_SIZE : 64;
+
+    tt->clusters = aligned_alloc(alignment, size);
+
+    if (tt->clusters == NULL)
+        return -2;
+
+#ifdef MADV_HUGEPAGE
+    if (alignment == CU_TT_HUGE_PAGE_SIZE)
+        madvise(tt->clusters, size, MADV_HUGEPAGE);
+#endif
+
+    tt->clusterCount = count;
+    tt_clear(tt, threads);
+    return 0;
+}
+
+void tt_destroy(TranspositionTable *tt) {
+    free(tt->clusters);
+    tt->clusters = NULL;
+    tt->clusterCount = 0;
+}
+
+static void *__tt_clear_worker(void *ptr) {
+    __TTClearWorker *worker = ptr;
+
+    memset(worker->begin, 0, sizeof(TTCluster) * worker->count);
+    return NULL;
+}
+
+void tt_clear(TranspositionTable *tt, int threads) {
+    size_t size = sizeof(TTCluster) * tt->clusterCount;
+
+    // Don't bother spawning threads for small tables: each thread gets at
+    // least a huge page to clear.
+    if ((size_t)__cu_max(threads, 1) > size / CU_TT_HUGE_PAGE_SIZE)
+        threads = (int)__cu_max(size / CU_TT_HUGE_PAGE_SIZE, 1);
+
+    __TTClearWorker *workers = threads > 1 ? malloc(sizeof(__TTClearWorker) * (size_t)threads) : NULL;
+
+    if (workers == NULL) {
+        memset(tt->clusters, 0, size);
+        tt->generation8 = 0;
+        return ;
+    }
+
+    size_t slice = tt->clusterCount / (size_t)threads;
+
+    for (int t = 0; t < threads; ++t) {
+        workers[t].begin = tt->clusters + slice * (size_t)t;
+        workers[t].count = t == threads - 1 ? tt->clusterCount - slice * (size_t)t : slice;
+    }
+
+    // The calling thread clears the first slice. If a thread cannot be
+    // created, the calling thread clears its slice too.
+    int started = 1;
+
+    while (started < threads && !pthread_create(&workers[started].thread, NULL, __tt_clear_worker, &workers[started]))
+        ++started;
+
+    for (int t = started; t < threads; ++t)
+        __tt_clear_worker(&workers[t]);
+
+    __tt_clear_worker(&workers[0]);
+
+    for (int t = 1; t < started; ++t)
+        pthread_join(workers[t].thread, NULL);
+
+    free(workers);
+    tt->generation8 = 0;
+}
+
+TTEntry *tt_probe(TranspositionTable *tt, hashkey_t key, bool *found) {
+    TTEntry *entries = tt_cluster(tt, key)->entries;
+    uint16_t key16 = __tt_key16(key);
+
+    for (int i = 0; i < CU_TT_CLUSTER_SIZE; ++i)
+        if (entries[i].key16 == key16 || !entries[i].depth8) {
+            // Refresh the generation of the entry, so that it stays in the
+            // table for the current search.
+            entries[i].genBound8 = (uint8_t)(tt->generation8 | (entries[i].genBound8 & 0x7));
+            *found = !!entries[i].depth8;
+            return &entries[i];
+        }
+
+    TTEntry *replace = entries;
+
+    for (int i = 1; i < CU_TT_CLUSTER_SIZE; ++i)
+        if (replace->depth8 - __tt_relative_age(tt, replace) > entries[i].depth8 - __tt_relative_age(tt, &entries[i]))
+            replace = &entries[i];
+
+    *found = false;
+    return replace;
+}
+
+void tt_save(const TranspositionTable *tt, TTEntry *entry, hashkey_t key, int score, int eval,
+    bound_t bound, int depth, move_t move) {
+    uint16_t key16 = __tt_key16(key);
+    int depth8 = __cu_max(1, __cu_min(depth - CU_TT_DEPTH_OFFSET, UINT8_MAX));
+
+    if (move != NO_MOVE || key16 != entry->key16)
+        entry->move = move;
+
+    if (bound == BOUND_EXACT || key16 != entry->key16 || depth8 + 4 > entry->depth8
+        || __tt_relative_age(tt, entry)) {
+        entry->key16 = key16;
+        entry->score = (int16_t)__cu_max(__cu_min(score, INT16_MAX), INT16_MIN);
+        entry->eval = (int16_t)__cu_max(__cu_min(eval, INT16_MAX), INT16_MIN);
+        entry->depth8 = (uint8_t)depth8;
+        entry->genBound8 = (uint8_t)(tt->generation8 | bound);
+    }
+}
+
+int tt_hashfull(const TranspositionTable *tt) {
+    size_t clusters = tt->clusterCount < 1000 ? tt->clusterCount : 1000;
+    size_t count = 0;
+
+    for (size_t i = 0; i < clusters; ++i)
+        for (int j = 0; j < CU_TT_CLUSTER_SIZE; ++j)
+            count += tt->clusters[i].entries[j].depth8
+                && (tt->clusters[i].entries[j].genBound8 & 0xF8) == tt->generation8;
+
+    return (int)(count * 1000 / (clusters * CU_TT_CLUSTER_SIZE));
+}
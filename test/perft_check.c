@@ -1,8 +1,17 @@
+#include "cu_dataset.h"
+#include "cu_epd.h"
 #include "cu_movegen.h"
+#include "cu_pack.h"
+#include "cu_perft.h"
+#include "cu_polyglot.h"
+#include "cu_position.h"
+#include "cu_tt.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 
 const char *PERFT_LIST[] = {
@@ -26,13 +35,13 @@ unsigned long perft(Board *board, int depth) {
     if (depth == 0)
         return 1;
 
+    if (depth == 1)
+        return board_count_legal_moves(board);
+
     Movelist mlist;
 
     mlist_generate_legal(&mlist, board);
 
-    if (depth == 1)
-        return mlist_size(&mlist);
-
     Boardstack stack;
     unsigned long count = 0;
 
@@ -45,6 +54,1020 @@ unsigned long perft(Board *board, int depth) {
     return count;
 }
 
+// Same as perft(), but iterates over moves with a move picker. The TT move is
+// the reverse of our last move, and the killers are the last moves played
+// at the same depth, so that the validation paths of the picker are used.
+unsigned long perft_picker(Board *board, int depth) {
+    static move_t killerTable[64][2];
+
+    if (depth == 0)
+        return 1;
+
+    MovePicker mp;
+    Boardstack stack;
+    unsigned long count = 0;
+    move_t move = NO_MOVE;
+
+    if (board->stack->prev && board->stack->prev->prev) {
+        move = board->stack->prev->lastMove;
+        move = create_move(move_to(move), move_from(move), NORMAL_MOVE);
+    }
+
+    movepicker_init(&mp, board, move, killerTable[depth]);
+
+    while ((move = movepicker_next(&mp)) != NO_MOVE) {
+        killerTable[depth][1] = killerTable[depth][0];
+        killerTable[depth][0] = move;
+
+        board_push(board, move, &stack);
+        count += perft_picker(board, depth - 1);
+        board_pop(board);
+    }
+
+    return count;
+}
+
+// Checks that board_move_is_pseudo_legal() accepts exactly the moves of the
+// pseudo-legal move list, for all possible move encodings, in all positions
+// up to the given depth.
+bool check_pseudo_legal(Board *board, int depth) {
+    Movelist mlist;
+
+    mlist_generate_pseudo_legal(&mlist, board);
+
+    for (unsigned int move = 0; move <= UINT16_MAX; ++move)
+        if (board_move_is_pseudo_legal(board, (move_t)move) != mlist_has_move(&mlist, (move_t)move))
+            return false;
+
+    if (depth == 0)
+        return true;
+
+    Boardstack stack;
+
+    mlist_generate_legal(&mlist, board);
+
+    for (move_t *iter = mlist_begin(&mlist); iter < mlist_end(&mlist); ++iter) {
+        board_push(board, *iter, &stack);
+
+        bool ok = check_pseudo_legal(board, depth - 1);
+
+        board_pop(board);
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+// Returns the index of the move in the list, or -1 if it isn't there.
+int move_index(const move_t *moves, size_t size, move_t move) {
+    for (size_t i = 0; i < size; ++i)
+        if (moves[i] == move)
+            return (int)i;
+
+    return -1;
+}
+
+// Checks that the CAPTURES and QUIETS lists split the pseudo-legal moves in
+// two disjoint sets, that QUIET_CHECKS holds exactly the quiet moves giving
+// check, and that smlist_sort() is a stable sort, in all positions up to the
+// given depth.
+bool check_gentypes(Board *board, int depth) {
+    Movelist pseudo, captures, quiets, checks;
+    ScoredMovelist smlist;
+    move_t unsorted[CU_MAX_MOVES];
+    size_t size;
+
+    mlist_generate_pseudo_legal(&pseudo, board);
+
+    if (!board_is_in_check(board)) {
+        size_t checkCount = 0;
+
+        mlist_generate(&captures, board, CAPTURES);
+        mlist_generate(&quiets, board, QUIETS);
+        mlist_generate(&checks, board, QUIET_CHECKS);
+
+        // With matching sizes, covering all pseudo-legal moves means that the
+        // two lists are disjoint and hold no other moves.
+        if (mlist_size(&captures) + mlist_size(&quiets) != mlist_size(&pseudo))
+            return false;
+
+        for (const move_t *iter = mlist_cbegin(&pseudo); iter < mlist_cend(&pseudo); ++iter)
+            if (mlist_has_move(&captures, *iter) == mlist_has_move(&quiets, *iter))
+                return false;
+
+        for (const move_t *iter = mlist_cbegin(&quiets); iter < mlist_cend(&quiets); ++iter)
+            if (board_move_gives_check(board, *iter)) {
+                if (!mlist_has_move(&checks, *iter))
+                    return false;
+                ++checkCount;
+            }
+
+        if (checkCount != mlist_size(&checks))
+            return false;
+    }
+
+    smlist_generate(&smlist, board, board_is_in_check(board) ? EVASIONS : NON_EVASIONS);
+    smlist_score_mvv_lva(&smlist, board);
+    size = smlist_size(&smlist);
+    memcpy(unsorted, smlist.moves, size * sizeof(move_t));
+    smlist_sort(&smlist);
+
+    for (size_t i = 1; i < size; ++i) {
+        if (smlist.scores[i - 1] < smlist.scores[i])
+            return false;
+
+        if (smlist.scores[i - 1] == smlist.scores[i]
+            && move_index(unsorted, size, smlist.moves[i - 1]) > move_index(unsorted, size, smlist.moves[i]))
+            return false;
+    }
+
+    if (depth == 0)
+        return true;
+
+    Boardstack stack;
+
+    mlist_generate_legal(&pseudo, board);
+
+    for (move_t *iter = mlist_begin(&pseudo); iter < mlist_end(&pseudo); ++iter) {
+        board_push(board, *iter, &stack);
+
+        bool ok = check_gentypes(board, depth - 1);
+
+        board_pop(board);
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+// Checks cu_perft() with several threads against the expected node count,
+// with and without a cache (twice, so that cached counts get used), then after
+// playing the first legal move against perft().
+bool check_threaded_perft(Board *board, int depth, unsigned long expected) {
+    Boardstack stacks[64];
+    Boardstack stack;
+    Movelist mlist;
+    PerftCache cache;
+    uint64_t nodes;
+
+    if (cu_perft_stack_count(board, depth, 3) > 64
+        || cu_perft(&nodes, board, depth, 3, stacks, NULL) || nodes != expected
+        || perft_cache_init(&cache, 1))
+        return false;
+
+    bool ok = !cu_perft(&nodes, board, depth, 3, stacks, &cache) && nodes == expected
+        && !cu_perft(&nodes, board, depth, 3, stacks, &cache) && nodes == expected;
+
+    mlist_generate_legal(&mlist, board);
+    board_push(board, *mlist_begin(&mlist), &stack);
+
+    ok = ok && !cu_perft(&nodes, board, depth - 1, 3, NULL, &cache) && nodes == perft(board, depth - 1);
+
+    board_pop(board);
+    perft_cache_destroy(&cache);
+    return ok;
+}
+
+// Checks perft() on boards using the internal stack allocator, with and
+// without a stack buffer (smaller than the depth, so that the allocator has to
+// grow), on such a board moved to another address, and on deep and shallow
+// copies of it.
+bool check_stack_allocators(const char *fen, int depth, unsigned long expected) {
+    Board board, copy, rootCopy;
+    Boardstack buffer[2];
+    Movelist mlist;
+    bool ok;
+
+    if (board_from_fen(&board, NULL, fen))
+        return false;
+
+    hashkey_t rootKey = board_key(&board);
+
+    ok = perft(&board, depth) == expected
+        && !board_use_stack_buffer(&board, buffer, 2)
+        && perft(&board, depth) == expected;
+
+    // The board must keep working when moved to another address.
+    copy = board;
+    memset(&board, 0, sizeof(Board));
+    ok = ok && perft(&copy, depth) == expected;
+    board = copy;
+
+    mlist_generate_legal(&mlist, &board);
+    board_push(&board, *mlist_begin(&mlist), NULL);
+
+    if (ok && !board_copy(&copy, &board)) {
+        ok = board_key(&copy) == board_key(&board) && perft(&copy, depth - 1) == perft(&board, depth - 1);
+        board_destroy(&copy);
+    }
+    else
+        ok = false;
+
+    if (ok) {
+        board_copy_shallow(&copy, &board);
+        ok = copy.stack == board.stack && perft(&copy, depth - 1) == perft(&board, depth - 1);
+
+        // Popping below the shared history must leave the source untouched.
+        board_pop(&copy);
+        ok = ok && perft(&copy, depth) == expected && board.stack->prev != NULL;
+        board_destroy(&copy);
+    }
+
+    if (ok && !board_copy_root(&rootCopy, &board, NULL)) {
+        ok = board_key(&rootCopy) == rootKey && rootCopy.stack->prev == NULL && perft(&rootCopy, depth) == expected;
+        board_destroy(&rootCopy);
+    }
+    else
+        ok = false;
+
+    board_destroy(&board);
+    return ok;
+}
+
+// Structure for running perft() on a separate thread.
+typedef struct PerftJob_ {
+    Board *board;
+    int depth;
+    unsigned long count;
+} PerftJob;
+
+void *perft_job(void *arg) {
+    PerftJob *job = arg;
+
+    job->count = perft(job->board, job->depth);
+    return NULL;
+}
+
+// Checks that a shallow copy can push and generate moves on another thread
+// while the source board keeps being used, both sharing the same history. The
+// source is set up from scratch, so that none of its check info is computed
+// before the copy.
+bool check_shallow_copy_threads(const char *fen, int depth, unsigned long expected) {
+    Board board, copy;
+    Boardstack stack;
+    PerftJob job = {&copy, depth, 0};
+    pthread_t thread;
+    unsigned long count;
+
+    if (board_from_fen(&board, &stack, fen))
+        return false;
+
+    board_copy_shallow(&copy, &board);
+
+    if (pthread_create(&thread, NULL, perft_job, &job)) {
+        board_destroy(&copy);
+        return false;
+    }
+
+    count = perft(&board, depth);
+    pthread_join(thread, NULL);
+    board_destroy(&copy);
+    board_destroy(&board);
+
+    return count == expected && job.count == expected;
+}
+
+// Checks the FEN writers against the FEN the board was created from, with
+// buffers of various sizes.
+bool check_write_fen(const Board *board, const char *fen, size_t fenLength) {
+    Board boards[2] = {*board, *board};
+    char buf[CU_FEN_MAX_LENGTH * 2];
+    size_t length;
+
+    if (board_write_fen(board, buf, sizeof(buf)) != fenLength || memcmp(buf, fen, fenLength) || buf[fenLength])
+        return false;
+
+    if (board_write_fen(board, buf, fenLength) != 0 || board_write_fen(board, buf, fenLength + 1) != fenLength)
+        return false;
+
+    if (board_write_fen_batch(boards, 2, buf, sizeof(buf), &length) != 2 || length != 2 * fenLength + 2
+        || memcmp(buf + fenLength + 1, fen, fenLength) || buf[length - 1] != '\n' || buf[length])
+        return false;
+
+    return board_write_fen_batch(boards, 2, buf, 2 * fenLength + 2, &length) == 1
+        && length == fenLength + 1 && !buf[length];
+}
+
+// Checks that packing and unpacking the positions of the tree of the given
+// depth gives back the same positions.
+bool check_pack(Board *board, int depth) {
+    char fen[CU_FEN_MAX_LENGTH], unpackedFen[CU_FEN_MAX_LENGTH];
+    PackedBoard packed;
+    Board unpacked;
+    Boardstack unpackedStack, stack;
+    Movelist mlist;
+
+    if (board_pack(&packed, board) || board_unpack(&unpacked, &unpackedStack, &packed))
+        return false;
+
+    board_write_fen(board, fen, sizeof(fen));
+    board_write_fen(&unpacked, unpackedFen, sizeof(unpackedFen));
+
+    if (strcmp(fen, unpackedFen) || board_key(&unpacked) != board_key(board)
+        || board_material_key(&unpacked) != board_material_key(board))
+        return false;
+
+    if (depth == 0)
+        return true;
+
+    mlist_generate_legal(&mlist, board);
+
+    for (move_t *iter = mlist_begin(&mlist); iter < mlist_end(&mlist); ++iter) {
+        board_push(board, *iter, &stack);
+
+        bool ok = check_pack(board, depth - 1);
+
+        board_pop(board);
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+// Checks that a dataset of the children of the board, written with and
+// without payload, gives back the same positions and payloads.
+bool check_dataset(Board *board) {
+    char path[] = "/tmp/perft_check_XXXXXX";
+    int fd = mkstemp(path);
+    Movelist mlist;
+    bool ok = fd >= 0;
+
+    if (fd >= 0)
+        close(fd);
+
+    mlist_generate_legal(&mlist, board);
+
+    for (int flags = 0; ok && flags <= DATASET_PAYLOAD; ++flags) {
+        DatasetWriter writer;
+        Dataset dataset;
+        DatasetIterator iter;
+        Boardstack stack;
+        size_t i = 0;
+
+        ok = !dataset_writer_open(&writer, path, flags);
+
+        for (move_t *move = mlist_begin(&mlist); ok && move < mlist_end(&mlist); ++move) {
+            board_push(board, *move, &stack);
+            ok = !dataset_write(&writer, board, (int)(move - mlist_begin(&mlist)) - 10, DRAWN_GAME, *move);
+            board_pop(board);
+        }
+
+        // Always close the writer, even after a failed write.
+        ok = !dataset_writer_close(&writer) && ok;
+
+        if (!ok || dataset_open(&dataset, path)) {
+            ok = false;
+            break ;
+        }
+
+        ok = dataset_size(&dataset) == mlist_size(&mlist);
+        dataset_iter_init(&iter, &dataset, 0, UINT64_MAX);
+
+        for (const DatasetRecord *record; ok && (record = dataset_iter_next(&iter)) != NULL; ++i) {
+            Board child;
+            Boardstack childStack;
+            move_t move = mlist.moves[i];
+
+            board_push(board, move, &stack);
+            ok = !dataset_record_board(&child, &childStack, record) && board_key(&child) == board_key(board);
+            board_pop(board);
+
+            if (flags & DATASET_PAYLOAD)
+                ok = ok && dataset_record_score(record) == (int)i - 10
+                    && dataset_record_outcome(record) == DRAWN_GAME && dataset_record_move(record) == move;
+        }
+
+        ok = ok && i == mlist_size(&mlist);
+        dataset_close(&dataset);
+    }
+
+    unlink(path);
+    return ok;
+}
+
+// Checks the EPD loader on the test positions, written as EPD records with
+// opcodes, against the positions built from their FENs. The records are
+// repeated so that the file is split between several threads.
+#define EPD_REPEAT 200
+#define EPD_RECORDS (EPD_REPEAT * (sizeof(PERFT_LIST) / sizeof(PERFT_LIST[0]) - 1))
+
+bool check_epd_loader(void) {
+    static char buffer[EPD_RECORDS * (CU_FEN_MAX_LENGTH + 64)];
+    static Position positions[EPD_RECORDS];
+    static EpdOpcodes opcodes[EPD_RECORDS];
+    static const char *const suffix = " bm e4 Nf3; id \"test;1\"; hmvc 7; c0 \"comment\";";
+    Position expected;
+    EpdFile file;
+    size_t length = 0, count, testCount;
+
+    for (testCount = 0; PERFT_LIST[testCount] != NULL; ++testCount);
+
+    for (size_t i = 0; i < EPD_REPEAT * testCount; ++i) {
+        // Keep the first four FEN fields only.
+        const char *fen = PERFT_LIST[i % testCount];
+        size_t fieldsLength = 0;
+
+        for (int field = 0; field < 4; ++field) {
+            fieldsLength += strspn(fen + fieldsLength, " ");
+            fieldsLength += strcspn(fen + fieldsLength, " ");
+        }
+
+        length += sprintf(buffer + length, "%.*s%s\n", (int)fieldsLength, fen, i % 2 ? suffix : "");
+    }
+
+    for (int threads = 1; threads <= 3; ++threads) {
+        epd_open_buffer(&file, buffer, length);
+
+        if (epd_count_records(&file) != EPD_REPEAT * testCount
+            || epd_load(&file, positions, opcodes, EPD_RECORDS, &count, threads)
+            || count != EPD_REPEAT * testCount)
+            return false;
+
+        for (size_t i = 0; i < count; ++i) {
+            position_from_fen(&expected, PERFT_LIST[i % testCount]);
+            expected.rule50 = i % 2 ? 7 : 0;
+
+            if (memcmp(&positions[i], &expected, sizeof(Position)))
+                return false;
+
+            if (i % 2 && (opcodes[i].bm.length != 6 || memcmp(opcodes[i].bm.str, "e4 Nf3", 6)
+                || opcodes[i].id.length != 6 || memcmp(opcodes[i].id.str, "test;1", 6)
+                || opcodes[i].c0.length != 7 || memcmp(opcodes[i].c0.str, "comment", 7)))
+                return false;
+
+            if (!(i % 2) && (opcodes[i].bm.str || opcodes[i].id.str || opcodes[i].c0.str))
+                return false;
+        }
+
+        epd_close(&file);
+    }
+
+    // Invalid records are reported with their index.
+    const char *invalid = "8/8/8/8/8/8/8/K6k w - -\n\n8/8/8/8/8/8/8/K6K w - -\n";
+
+    epd_open_buffer(&file, invalid, strlen(invalid));
+
+    if (epd_load(&file, positions, NULL, 16, &count, 1) != -1 || count != 1)
+        return false;
+
+    // Huge move numbers saturate, and opcodes without operands are skipped.
+    const char *edges = "4k3/8/8/8/8/8/8/4K3 w - - 0 99999999999\n"
+        "4k3/8/8/8/8/8/8/4K3 w - - noop; bm Kd2; draw_claim;\n";
+
+    epd_open_buffer(&file, edges, strlen(edges));
+    return !epd_load(&file, positions, opcodes, 16, &count, 1) && count == 2
+        && opcodes[1].bm.length == 3 && !memcmp(opcodes[1].bm.str, "Kd2", 3);
+}
+
+// Checks the repetition counts while shuffling Knights from the starting
+// position, for long enough that the key history of the board wraps around.
+bool check_repetitions(void) {
+    const move_t shuffle[4] = {
+        create_move(SQ_G1, SQ_F3, NORMAL_MOVE), create_move(SQ_G8, SQ_F6, NORMAL_MOVE),
+        create_move(SQ_F3, SQ_G1, NORMAL_MOVE), create_move(SQ_F6, SQ_G8, NORMAL_MOVE)
+    };
+    Board board;
+    bool ok = !board_from_fen(&board, NULL, STARTING_FEN);
+
+    for (int ply = 1; ok && ply <= 400; ++ply) {
+        ok = !board_push(&board, shuffle[(ply - 1) % 4], NULL)
+            && board.stack->repetition == ply / 4
+            && board_is_threefold_draw(&board) == (ply >= 8)
+            && board_is_fivefold_draw(&board) == (ply >= 16);
+    }
+
+    // Irreversible moves and null moves reset the repetition window.
+    if (ok) {
+        ok = !board_push_nullmove(&board, NULL) && board.stack->repetition == 0;
+        board_pop(&board);
+        ok = ok && !board_push(&board, create_move(SQ_E2, SQ_E4, NORMAL_MOVE), NULL)
+            && board.stack->repetition == 0;
+    }
+
+    board_reset(&board);
+    ok = ok && board.stack->repetition == 0 && board.historyPly == 0;
+
+    // Take back a line longer than the key history, so that the history
+    // slots of the earlier plies hold keys of the discarded line.
+    const move_t queenside[4] = {
+        create_move(SQ_B1, SQ_C3, NORMAL_MOVE), create_move(SQ_B8, SQ_C6, NORMAL_MOVE),
+        create_move(SQ_C3, SQ_B1, NORMAL_MOVE), create_move(SQ_C6, SQ_B8, NORMAL_MOVE)
+    };
+
+    for (int ply = 0; ok && ply < 8; ++ply)
+        ok = !board_push(&board, queenside[ply % 4], NULL);
+
+    for (int ply = 0; ok && ply < 292; ++ply)
+        ok = !board_push(&board, shuffle[ply % 4], NULL);
+
+    while (ok && board.historyPly > 8)
+        board_pop(&board);
+
+    ok = ok && !board_push(&board, queenside[0], NULL)
+        && board.stack->repetition == 2 && board_is_threefold_draw(&board);
+
+    board_destroy(&board);
+    return ok;
+}
+
+// Checks the static exchange evaluation on a few positions with x-rays, pins,
+// King recaptures, en passant captures and promotions.
+bool check_see(void) {
+    const struct { const char *fen; move_t move; int value; } tests[] = {
+        {"1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", create_move(SQ_E1, SQ_E5, NORMAL_MOVE), 100},
+        {"1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1", create_move(SQ_D3, SQ_E5, NORMAL_MOVE), -200},
+        {"1k6/8/1n6/3p4/8/5B2/8/1R2K3 w - - 0 1", create_move(SQ_F3, SQ_D5, NORMAL_MOVE), 100},
+        {"8/8/8/8/8/5k2/4r3/K3R3 w - - 0 1", create_move(SQ_E1, SQ_E2, NORMAL_MOVE), 0},
+        {"8/8/8/8/8/5k2/4r3/K2BR3 w - - 0 1", create_move(SQ_E1, SQ_E2, NORMAL_MOVE), 500},
+        {"4k3/8/8/3Pp3/8/8/8/4K3 w - e6 0 1", create_move(SQ_D5, SQ_E6, EN_PASSANT), 100},
+        {"7r/1P6/8/8/8/8/k7/4K3 w - - 0 1", create_promotion(SQ_B7, SQ_B8, QUEEN), -100}
+    };
+    Board board;
+    bool ok = true;
+
+    for (size_t i = 0; ok && i < sizeof(tests) / sizeof(tests[0]); ++i) {
+        ok = !board_from_fen(&board, NULL, tests[i].fen)
+            && board_see(&board, tests[i].move) == tests[i].value
+            && board_see_ge(&board, tests[i].move, tests[i].value)
+            && !board_see_ge(&board, tests[i].move, tests[i].value + 1);
+        board_destroy(&board);
+    }
+
+    return ok;
+}
+
+// Checks that board_see_ge() agrees with board_see() for all moves, and that
+// smlist_split_see() splits captures on the threshold.
+bool check_see_consistency(Board *board, int depth) {
+    ScoredMovelist smlist;
+    Movelist mlist;
+    Boardstack stack;
+
+    smlist_generate(&smlist, board, board_is_in_check(board) ? EVASIONS : CAPTURES);
+
+    move_t *split = smlist_split_see(&smlist, board, 0);
+
+    for (move_t *iter = smlist_begin(&smlist); iter < smlist_end(&smlist); ++iter)
+        if (board_see_ge(board, *iter, 0) != (iter < split))
+            return false;
+
+    mlist_generate_legal(&mlist, board);
+
+    for (const move_t *iter = mlist_cbegin(&mlist); iter < mlist_cend(&mlist); ++iter) {
+        int value = board_see(board, *iter);
+
+        if (!board_see_ge(board, *iter, value) || board_see_ge(board, *iter, value + 1))
+            return false;
+
+        if (depth > 1) {
+            board_push(board, *iter, &stack);
+            bool ok = check_see_consistency(board, depth - 1);
+            board_pop(board);
+
+            if (!ok)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Checks the SAN of a few moves with disambiguations, pins, checks, mates,
+// promotions, en passant captures and castlings, and the rejection of invalid
+// SAN moves.
+bool check_san(void) {
+    const struct { const char *fen; move_t move; const char *san; } tests[] = {
+        {"7k/8/8/8/8/8/8/R4RK1 w - - 0 1", create_move(SQ_A1, SQ_D1, NORMAL_MOVE), "Rad1"},
+        {"7k/8/8/R7/8/8/8/R5K1 w - - 0 1", create_move(SQ_A1, SQ_A3, NORMAL_MOVE), "R1a3"},
+        {"8/7k/8/8/8/Q7/8/Q1Q3K1 w - - 0 1", create_move(SQ_A1, SQ_B2, NORMAL_MOVE), "Qa1b2"},
+        {"4k3/8/8/8/1b6/6N1/3N4/4K3 w - - 0 1", create_move(SQ_G3, SQ_E4, NORMAL_MOVE), "Ne4"},
+        {"6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", create_move(SQ_A1, SQ_A8, NORMAL_MOVE), "Ra8#"},
+        {"1n2k3/P7/8/8/8/8/8/4K3 w - - 0 1", create_promotion(SQ_A7, SQ_B8, QUEEN), "axb8=Q+"},
+        {"4k3/8/8/3Pp3/8/8/8/4K3 w - e6 0 1", create_move(SQ_D5, SQ_E6, EN_PASSANT), "dxe6"},
+        {"r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", create_move(SQ_E1, SQ_H1, CASTLING), "O-O"},
+        {"r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1", create_move(SQ_E8, SQ_A8, CASTLING), "O-O-O"}
+    };
+    const struct { const char *fen; const char *san; move_t move; } parses[] = {
+        {STARTING_FEN, "e4 e5", create_move(SQ_E2, SQ_E4, NORMAL_MOVE)},
+        {STARTING_FEN, "Nf3!?", create_move(SQ_G1, SQ_F3, NORMAL_MOVE)},
+        {"r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", "0-0-0", create_move(SQ_E1, SQ_A1, CASTLING)},
+        {STARTING_FEN, "Ne5", NO_MOVE},
+        {STARTING_FEN, "e5", NO_MOVE},
+        {STARTING_FEN, "O-O", NO_MOVE},
+        {STARTING_FEN, "e4x", NO_MOVE},
+        {"7k/8/8/8/8/8/8/R4RK1 w - - 0 1", "Rd1", NO_MOVE},
+        {"1n2k3/P7/8/8/8/8/8/4K3 w - - 0 1", "axb8", NO_MOVE},
+        {"1n2k3/P7/8/8/8/8/8/4K3 w - - 0 1", "a8=K", NO_MOVE}
+    };
+    Board board;
+    char san[CU_SAN_MAX_LENGTH];
+    bool ok = true;
+
+    for (size_t i = 0; ok && i < sizeof(tests) / sizeof(tests[0]); ++i) {
+        ok = !board_from_fen(&board, NULL, tests[i].fen)
+            && board_move_to_san(&board, tests[i].move, san, sizeof(san)) == strlen(tests[i].san)
+            && !strcmp(san, tests[i].san)
+            && board_san_to_move(&board, tests[i].san) == tests[i].move
+            && board_move_to_san(&board, tests[i].move, san, strlen(tests[i].san)) == 0;
+        board_destroy(&board);
+    }
+
+    for (size_t i = 0; ok && i < sizeof(parses) / sizeof(parses[0]); ++i) {
+        ok = !board_from_fen(&board, NULL, parses[i].fen)
+            && board_san_to_move(&board, parses[i].san) == parses[i].move;
+        board_destroy(&board);
+    }
+
+    return ok;
+}
+
+// Checks that the SAN of every legal move is parsed back to the same move,
+// and that its suffix matches the checks and mates of the resulting position.
+bool check_san_round_trip(Board *board, int depth) {
+    char san[CU_SAN_MAX_LENGTH];
+    Boardstack stack;
+    Movelist mlist;
+
+    mlist_generate_legal(&mlist, board);
+
+    for (const move_t *iter = mlist_cbegin(&mlist); iter < mlist_cend(&mlist); ++iter) {
+        size_t length = board_move_to_san(board, *iter, san, sizeof(san));
+
+        if (!length || board_san_to_move(board, san) != *iter)
+            return false;
+
+        board_push(board, *iter, &stack);
+
+        char suffix = board_is_checkmate(board) ? '#' : board_is_in_check(board) ? '+' : '\0';
+        bool ok = (suffix == '\0' ? strchr("+#", san[length - 1]) == NULL : san[length - 1] == suffix)
+            && (depth <= 1 || check_san_round_trip(board, depth - 1));
+
+        board_pop(board);
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+// Checks the storage, replacement and clearing of transposition table entries.
+bool check_tt(void) {
+    TranspositionTable tt;
+    const hashkey_t key = UINT64_C(0x0123456789ABCDEF);
+    const move_t move = create_move(SQ_E2, SQ_E4, NORMAL_MOVE);
+    TTEntry *entry;
+    bool found;
+
+    if (tt_init(&tt, 4, 2))
+        return false;
+
+    tt_prefetch(&tt, key);
+    entry = tt_probe(&tt, key, &found);
+    bool ok = !found;
+
+    tt_save(&tt, entry, key, -50, 20, BOUND_LOWER, 6, move);
+    entry = tt_probe(&tt, key, &found);
+    ok = ok && found && tt_entry_move(entry) == move && tt_entry_score(entry) == -50
+        && tt_entry_eval(entry) == 20 && tt_entry_bound(entry) == BOUND_LOWER && tt_entry_depth(entry) == 6;
+
+    // Shallow data doesn't replace deeper data, but keeps the previous move.
+    tt_save(&tt, entry, key, 0, 0, BOUND_UPPER, 1, NO_MOVE);
+    ok = ok && tt_entry_depth(entry) == 6 && tt_entry_move(entry) == move;
+    tt_save(&tt, entry, key, 10, 20, BOUND_EXACT, 1, NO_MOVE);
+    ok = ok && tt_entry_depth(entry) == 1 && tt_entry_score(entry) == 10 && tt_entry_move(entry) == move;
+
+    // Keys differing only in their upper bits share the same cluster: the
+    // shallowest entry gets replaced, unless an entry is from an older search.
+    for (int i = 1; i < CU_TT_CLUSTER_SIZE; ++i) {
+        hashkey_t other = key ^ ((hashkey_t)i << 48);
+
+        entry = tt_probe(&tt, other, &found);
+        tt_save(&tt, entry, other, 0, 0, BOUND_EXACT, 1 + i, NO_MOVE);
+    }
+
+    entry = tt_probe(&tt, key ^ ((hashkey_t)7 << 48), &found);
+    ok = ok && !found && tt_entry_depth(entry) == 1;
+
+    tt_new_search(&tt);
+    tt_probe(&tt, key, &found);
+    entry = tt_probe(&tt, key ^ ((hashkey_t)7 << 48), &found);
+    ok = ok && !found && tt_entry_depth(entry) == 2;
+
+    tt_clear(&tt, 4);
+    tt_probe(&tt, key, &found);
+    ok = ok && !found && tt_hashfull(&tt) == 0;
+
+    // Quiescence depths down to -7 are kept, lower ones are clamped.
+    entry = tt_probe(&tt, key, &found);
+    tt_save(&tt, entry, key, 0, 0, BOUND_EXACT, -7, NO_MOVE);
+    ok = ok && tt_entry_depth(entry) == -7;
+    tt_save(&tt, entry, key, 0, 0, BOUND_EXACT, -20, NO_MOVE);
+    ok = ok && tt_entry_depth(entry) == -7;
+    tt_destroy(&tt);
+    return ok;
+}
+
+// Checks the Polyglot keys against the reference keys of the Polyglot
+// documentation, reached by playing the moves from the starting position.
+bool check_polyglot_keys(void) {
+    const struct { move_t move; hashkey_t key; } lines[2][8] = {
+        {
+            {NO_MOVE, UINT64_C(0x463B96181691FC9C)},
+            {create_move(SQ_E2, SQ_E4, NORMAL_MOVE), UINT64_C(0x823C9B50FD114196)},
+            {create_move(SQ_D7, SQ_D5, NORMAL_MOVE), UINT64_C(0x0756B94461C50FB0)},
+            {create_move(SQ_E4, SQ_E5, NORMAL_MOVE), UINT64_C(0x662FAFB965DB29D4)},
+            {create_move(SQ_F7, SQ_F5, NORMAL_MOVE), UINT64_C(0x22A48B5A8E47FF78)},
+            {create_move(SQ_E1, SQ_E2, NORMAL_MOVE), UINT64_C(0x652A607CA3F242C1)},
+            {create_move(SQ_E8, SQ_F7, NORMAL_MOVE), UINT64_C(0x00FDD303C946BDD9)},
+            {NO_MOVE, 0}
+        },
+        {
+            {create_move(SQ_A2, SQ_A4, NORMAL_MOVE), 0},
+            {create_move(SQ_B7, SQ_B5, NORMAL_MOVE), 0},
+            {create_move(SQ_H2, SQ_H4, NORMAL_MOVE), 0},
+            {create_move(SQ_B5, SQ_B4, NORMAL_MOVE), 0},
+            {create_move(SQ_C2, SQ_C4, NORMAL_MOVE), UINT64_C(0x3C8123EA7B067637)},
+            {create_move(SQ_B4, SQ_C3, EN_PASSANT), 0},
+            {create_move(SQ_A1, SQ_A3, NORMAL_MOVE), UINT64_C(0x5C3F9B829B279560)},
+            {NO_MOVE, 0}
+        }
+    };
+    bool ok = true;
+
+    for (int l = 0; ok && l < 2; ++l) {
+        Board board;
+
+        ok = !board_from_fen(&board, NULL, STARTING_FEN);
+
+        for (int i = 0; ok && (i == 0 || lines[l][i].move != NO_MOVE); ++i) {
+            if (lines[l][i].move != NO_MOVE)
+                ok = !board_push(&board, lines[l][i].move, NULL);
+
+            ok = ok && (!lines[l][i].key || board_polyglot_key(&board) == lines[l][i].key);
+        }
+
+        board_destroy(&board);
+    }
+
+    return ok;
+}
+
+// Checks that the Polyglot keys maintained by board_push() and
+// board_push_nullmove() match the keys of boards set up from scratch.
+bool check_polyglot_incremental(Board *board, int depth) {
+    char fen[CU_FEN_MAX_LENGTH];
+    Board fresh;
+    Boardstack stack;
+    Movelist mlist;
+
+    if (!board_write_fen(board, fen, sizeof(fen)) || board_from_fen(&fresh, &stack, fen)
+        || board_polyglot_key(&fresh) != board_polyglot_key(board))
+        return false;
+
+    if (depth == 0)
+        return true;
+
+    if (!board_is_in_check(board)) {
+        board_push_nullmove(board, &stack);
+        bool ok = check_polyglot_incremental(board, 0);
+        board_pop(board);
+
+        if (!ok)
+            return false;
+    }
+
+    mlist_generate_legal(&mlist, board);
+
+    for (const move_t *iter = mlist_cbegin(&mlist); iter < mlist_cend(&mlist); ++iter) {
+        board_push(board, *iter, &stack);
+        bool ok = check_polyglot_incremental(board, depth - 1);
+        board_pop(board);
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+// Checks the lookups in a small Polyglot book, from a buffer and from a file.
+bool check_polyglot_book(void) {
+    struct { const char *fen; uint16_t move; uint16_t weight; move_t expected; } tests[] = {
+        {STARTING_FEN, SQ_E4 | (SQ_E2 << 6), 3, create_move(SQ_E2, SQ_E4, NORMAL_MOVE)},
+        {STARTING_FEN, SQ_D4 | (SQ_D2 << 6), 1, create_move(SQ_D2, SQ_D4, NORMAL_MOVE)},
+        {STARTING_FEN, SQ_E5 | (SQ_E2 << 6), 100, NO_MOVE},
+        {"r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", SQ_H1 | (SQ_E1 << 6), 1, create_move(SQ_E1, SQ_H1, CASTLING)},
+        {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", SQ_F6 | (SQ_E5 << 6), 1,
+            create_move(SQ_E5, SQ_F6, EN_PASSANT)},
+        {"8/4P3/8/8/8/8/k7/4K3 w - - 0 1", SQ_E8 | (SQ_E7 << 6) | (4 << 12), 0, create_promotion(SQ_E7, SQ_E8, QUEEN)}
+    };
+    const size_t testCount = sizeof(tests) / sizeof(tests[0]);
+    uint8_t data[sizeof(tests) / sizeof(tests[0])][CU_POLYGLOT_ENTRY_SIZE];
+    hashkey_t keys[sizeof(tests) / sizeof(tests[0])];
+    Board board;
+    bool ok = true;
+
+    // Build the book by inserting the entries in key order.
+    for (size_t i = 0; ok && i < testCount; ++i) {
+        ok = !board_from_fen(&board, NULL, tests[i].fen);
+
+        hashkey_t key = board_polyglot_key(&board);
+        size_t j;
+
+        board_destroy(&board);
+
+        for (j = i; j > 0 && keys[j - 1] > key; --j) {
+            keys[j] = keys[j - 1];
+            memcpy(data[j], data[j - 1], CU_POLYGLOT_ENTRY_SIZE);
+        }
+
+        keys[j] = key;
+        memset(data[j], 0, CU_POLYGLOT_ENTRY_SIZE);
+
+        for (int b = 0; b < 8; ++b)
+            data[j][b] = (uint8_t)(key >> (56 - 8 * b));
+
+        data[j][8] = (uint8_t)(tests[i].move >> 8);
+        data[j][9] = (uint8_t)tests[i].move;
+        data[j][10] = (uint8_t)(tests[i].weight >> 8);
+        data[j][11] = (uint8_t)tests[i].weight;
+    }
+
+    char path[] = "/tmp/perft_check_XXXXXX";
+    int fd = mkstemp(path);
+
+    // Trailing bytes after the last entry are ignored, but still mapped.
+    ok = ok && fd >= 0 && write(fd, data, sizeof(data)) == (ssize_t)sizeof(data)
+        && write(fd, "end", 3) == 3;
+
+    if (fd >= 0)
+        close(fd);
+
+    for (int pass = 0; ok && pass < 2; ++pass) {
+        PolyglotBook book;
+        PolyglotEntry entries[8];
+
+        if (pass == 0)
+            polyglot_open_buffer(&book, data, sizeof(data));
+        else
+            ok = !polyglot_open(&book, path);
+
+        ok = ok && polyglot_size(&book) == testCount
+            && book.size == sizeof(data) + 3 * pass
+            && polyglot_find(&book, 0) == testCount;
+
+        for (size_t i = 0; ok && i < testCount; ++i) {
+            size_t count;
+
+            ok = !board_from_fen(&board, NULL, tests[i].fen);
+            count = polyglot_probe(&book, &board, entries, 8);
+
+            // The illegal move of the starting position is skipped, and the
+            // other moves are picked according to their weights.
+            if (tests[i].fen == STARTING_FEN)
+                ok = ok && count == 2 && entries[0].move == tests[0].expected && entries[1].move == tests[1].expected
+                    && polyglot_pick(&book, &board, 2) == tests[0].expected
+                    && polyglot_pick(&book, &board, 7) == tests[1].expected;
+
+            // Moves with a weight of zero are returned by probes, but never
+            // picked.
+            else if (tests[i].weight == 0)
+                ok = ok && count == 1 && entries[0].move == tests[i].expected
+                    && polyglot_pick(&book, &board, 0) == NO_MOVE;
+
+            else
+                ok = ok && count == 1 && entries[0].move == tests[i].expected && entries[0].weight == tests[i].weight
+                    && polyglot_pick(&book, &board, 12345) == tests[i].expected;
+
+            board_destroy(&board);
+        }
+
+        polyglot_close(&book);
+    }
+
+    unlink(path);
+    return ok;
+}
+
+// Same as perft(), but with copy-make on compact positions. The keys of the
+// positions are also compared to the keys of the board, whose moves are
+// played alongside, and to the keys given by board_key_after().
+unsigned long perft_position(const Position *pos, Board *board, int depth) {
+    if (position_key(pos) != board_key(board))
+        return 0;
+
+    if (depth == 0)
+        return 1;
+
+    Movelist mlist;
+    Boardstack stack;
+    Position child;
+    unsigned long count = 0;
+
+    position_generate_legal(&mlist, pos);
+
+    for (move_t *iter = mlist_begin(&mlist); iter < mlist_end(&mlist); ++iter) {
+        hashkey_t keyAfter = board_key_after(board, *iter);
+
+        position_make_move(&child, pos, *iter);
+        board_push(board, *iter, &stack);
+        count += board_key(board) == keyAfter ? perft_position(&child, board, depth - 1) : 0;
+        board_pop(board);
+    }
+
+    return count;
+}
+
+// Runs the consistency checks of the given perft test. They are kept out of
+// the timed perft loop, so that the reported speed only covers perft(). The
+// move picker, the compact position, the stack allocators and the threaded
+// perft are checked against the expected counts of the first depths.
+// Prints the failure and returns false if any check fails.
+bool check_perft_test(const char *test) {
+    const int fenLength = strcspn(test, "|") - 1;
+    const char *error = NULL;
+    const char *ptr = strchr(test, '|') + 1;
+    int depth = 0;
+    Board board;
+    Boardstack stack;
+
+    if (board_from_fen(&board, &stack, test)) {
+        printf("FAIL: board_from_fen() error: %s\n", board_get_error(&board));
+        return false;
+    }
+
+    if (!check_write_fen(&board, test, fenLength))
+        error = "FEN writer error";
+
+    else if (!check_pack(&board, 2))
+        error = "packed position error";
+
+    else if (!check_dataset(&board))
+        error = "dataset error";
+
+    else if (!check_see_consistency(&board, 2))
+        error = "static exchange evaluation error";
+
+    else if (!check_polyglot_incremental(&board, 2))
+        error = "Polyglot key error";
+
+    else if (!check_san_round_trip(&board, 2))
+        error = "SAN error";
+
+    else if (!check_pseudo_legal(&board, 1))
+        error = "pseudo-legality check error";
+
+    else if (!check_gentypes(&board, 2))
+        error = "move generation type error";
+
+    while (error == NULL && *ptr && depth < 4) {
+        char *endPtr;
+        unsigned long expected = strtoul(ptr, &endPtr, 10);
+        Position pos;
+
+        ++depth;
+        position_from_board(&pos, &board);
+
+        if (depth <= 3 && perft_picker(&board, depth) != expected)
+            error = "move picker error";
+
+        else if (perft_position(&pos, &board, depth) != expected)
+            error = "position error";
+
+        // Also check the internal stack allocator.
+        else if (depth == 3 && !check_stack_allocators(test, depth, expected))
+            error = "stack allocator error";
+
+        else if (depth == 3 && !check_shallow_copy_threads(test, depth, expected))
+            error = "shallow copy error";
+
+        // Also check the multi-threaded perft, both from the position itself
+        // and after a move, so that the history replay is used.
+        else if (depth == 4 && !check_threaded_perft(&board, depth, expected))
+            error = "threaded perft error";
+
+        ptr = endPtr + strspn(endPtr, " \t");
+    }
+
+    if (error == NULL)
+        return true;
+
+    if (depth)
+        printf("FAIL: %s for FEN '%.*s' at depth %d\n", error, fenLength, test, depth);
+    else
+        printf("FAIL: %s for FEN '%.*s'\n", error, fenLength, test);
+
+    fflush(stdout);
+    return false;
+}
+
 unsigned long get_time_ms() {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
@@ -60,10 +1083,51 @@ int main(void) {
     size_t testCount;
     for (testCount = 0; PERFT_LIST[testCount] != NULL; ++testCount);
 
+    if (!check_epd_loader()) {
+        puts("FAIL: EPD loader check error");
+        return 1;
+    }
+
+    if (!check_repetitions()) {
+        puts("FAIL: repetition check error");
+        return 1;
+    }
+
+    if (!check_polyglot_keys() || !check_polyglot_book()) {
+        puts("FAIL: Polyglot check error");
+        return 1;
+    }
+
+    if (!check_tt()) {
+        puts("FAIL: transposition table check error");
+        return 1;
+    }
+
+    if (!check_see()) {
+        puts("FAIL: static exchange evaluation check error");
+        return 1;
+    }
+
+    if (!check_san()) {
+        puts("FAIL: SAN check error");
+        return 1;
+    }
+
+    size_t i;
+    for (i = 0; i < testCount; ++i) {
+        printf("Checking perft test %lu/%lu... ", (unsigned long)i + 1, (unsigned long)testCount);
+        fflush(stdout);
+
+        if (!check_perft_test(PERFT_LIST[i]))
+            return 1;
+
+        puts("OK");
+        fflush(stdout);
+    }
+
     unsigned long start = get_time_ms();
     unsigned long nodes = 0;
 
-    size_t i;
     for (i = 0; i < testCount; ++i) {
         printf("Running perft test %lu/%lu... ", (unsigned long)i + 1, (unsigned long)testCount);
         fflush(stdout);
@@ -89,19 +1153,15 @@ int main(void) {
                 int fenLength = strcspn(PERFT_LIST[i], "|") - 1;
                 printf("\nFail for FEN '%.*s' at depth %d: expected %lu, got %lu\n",
                     fenLength, PERFT_LIST[i], depth, expected, count);
-                fflush(stdout);
-                break ;
+                return 1;
             }
             ptr = endPtr + strspn(endPtr, " \t");
         }
 
-        if (!*ptr) {
-            puts("OK");
-            fflush(stdout);
-        }
+        puts("OK");
+        fflush(stdout);
     }
 
-
     unsigned long elapsed = get_time_ms() - start;
 
     unsigned long nps = (nodes * 1000) / (elapsed + !elapsed);
@@ -0,0 +1,478 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Micro-benchmarks for the library primitives. Each kernel runs a fixed number
+// of rounds over a fixed position corpus, and prints one line with its name,
+// its operation count, and the average time per operation in nanoseconds and
+// in TSC cycles (or "-" on targets without a timestamp counter).
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+#include "cu_movegen.h"
+#include "cu_pack.h"
+#include "cu_polyglot.h"
+#include "cu_position.h"
+#include "cu_tt.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+static const char *const CORPUS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkb1r/pp3ppp/2n1pn2/2pp4/3P4/2PBPN2/PP3PPP/RNBQK2R w KQkq - 0 6",
+    "2r3k1/pp3pp1/4p2p/3pP3/1P1q4/P4Q1P/5PP1/2R3K1 b - - 0 30",
+    "8/5pk1/6p1/7p/P6P/6P1/5PK1/8 w - - 0 45",
+    "1qnnbrkb/rppp1ppp/p3p3/8/4P3/2PP1P2/PP4PP/RQNNBKRB w GA - 1 9",
+    NULL
+};
+
+#define CORPUS_MAX 16
+
+static Board boards[CORPUS_MAX];
+static Boardstack stacks[CORPUS_MAX];
+static Movelist moves[CORPUS_MAX];
+static Position positions[CORPUS_MAX];
+static size_t corpusSize;
+
+// Accumulates results of the kernels so that the compiler cannot optimize the
+// benchmarked calls away. It is printed at the end of the run.
+static uint64_t checksum;
+
+typedef struct BenchTimer_ {
+    struct timespec ts;
+    uint64_t tsc;
+} BenchTimer;
+
+static void timer_start(BenchTimer *timer) {
+    clock_gettime(CLOCK_MONOTONIC, &timer->ts);
+#ifdef BENCH_HAS_TSC
+    timer->tsc = __rdtsc();
+#endif
+}
+
+// Stops the timer and prints the results for the given kernel.
+static void timer_report(const BenchTimer *timer, const char *name, uint64_t ops) {
+    struct timespec ts;
+    uint64_t tsc = 0;
+
+#ifdef BENCH_HAS_TSC
+    tsc = __rdtsc() - timer->tsc;
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    double ns = (double)(ts.tv_sec - timer->ts.tv_sec) * 1e9 + (double)(ts.tv_nsec - timer->ts.tv_nsec);
+
+#ifdef BENCH_HAS_TSC
+    printf("%-24s %12" PRIu64 " ops %10.2f ns/op %10.2f cycles/op\n", name, ops, ns / ops, (double)tsc / ops);
+#else
+    (void)tsc;
+    printf("%-24s %12" PRIu64 " ops %10.2f ns/op %10s cycles/op\n", name, ops, ns / ops, "-");
+#endif
+    fflush(stdout);
+}
+
+static void bench_generate_legal(int rounds) {
+    BenchTimer timer;
+    Movelist mlist;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i, ++ops) {
+            mlist_generate_legal(&mlist, &boards[i]);
+            checksum += mlist_size(&mlist);
+        }
+    timer_report(&timer, "generate_legal", ops);
+}
+
+static void bench_generate_pseudo_legal(int rounds) {
+    BenchTimer timer;
+    Movelist mlist;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i, ++ops) {
+            mlist_generate_pseudo_legal(&mlist, &boards[i]);
+            checksum += mlist_size(&mlist);
+        }
+    timer_report(&timer, "generate_pseudo_legal", ops);
+}
+
+// Validates the legal moves of each position and of the next one, as a search
+// does with transposition table moves and killers, so that both accepted and
+// rejected moves are measured.
+static void bench_move_is_pseudo_legal(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (size_t k = i; k <= i + 1; ++k) {
+                const Movelist *candidates = &moves[k % corpusSize];
+
+                for (const move_t *iter = mlist_cbegin(candidates); iter < mlist_cend(candidates); ++iter, ++ops)
+                    checksum += board_move_is_pseudo_legal(&boards[i], *iter);
+            }
+    timer_report(&timer, "move_is_pseudo_legal", ops);
+}
+
+// Same as bench_move_is_pseudo_legal(), but generates the pseudo-legal moves
+// and searches the move in the list.
+static void bench_generate_has_move(int rounds) {
+    BenchTimer timer;
+    Movelist mlist;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (size_t k = i; k <= i + 1; ++k) {
+                const Movelist *candidates = &moves[k % corpusSize];
+
+                for (const move_t *iter = mlist_cbegin(candidates); iter < mlist_cend(candidates); ++iter, ++ops) {
+                    mlist_generate_pseudo_legal(&mlist, &boards[i]);
+                    checksum += mlist_has_move(&mlist, *iter);
+                }
+            }
+    timer_report(&timer, "generate_has_move", ops);
+}
+
+static void bench_push_pop(int rounds) {
+    BenchTimer timer;
+    Boardstack stack;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter, ++ops) {
+                board_push(&boards[i], *iter, &stack);
+                checksum += board_key(&boards[i]);
+                board_pop(&boards[i]);
+            }
+    timer_report(&timer, "push_pop", ops);
+}
+
+static void bench_position_make_move(int rounds) {
+    BenchTimer timer;
+    Position child;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter, ++ops) {
+                position_make_move(&child, &positions[i], *iter);
+                checksum += position_key(&child);
+            }
+    timer_report(&timer, "position_make_move", ops);
+}
+
+static void bench_position_generate_legal(int rounds) {
+    BenchTimer timer;
+    Movelist mlist;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i, ++ops) {
+            position_generate_legal(&mlist, &positions[i]);
+            checksum += mlist_size(&mlist);
+        }
+    timer_report(&timer, "position_generate_legal", ops);
+}
+
+static void bench_gives_check(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter, ++ops)
+                checksum += board_move_gives_check(&boards[i], *iter);
+    timer_report(&timer, "move_gives_check", ops);
+}
+
+static void bench_key_after(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter, ++ops)
+                checksum += board_key_after(&boards[i], *iter);
+    timer_report(&timer, "key_after", ops);
+}
+
+static void bench_polyglot_key(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i, ++ops)
+            checksum += board_polyglot_key(&boards[i]);
+    timer_report(&timer, "polyglot_key", ops);
+}
+
+static void bench_see(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter, ++ops)
+                checksum += (uint64_t)board_see(&boards[i], *iter);
+    timer_report(&timer, "see", ops);
+}
+
+static void bench_see_ge(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter, ++ops)
+                checksum += board_see_ge(&boards[i], *iter, 0);
+    timer_report(&timer, "see_ge", ops);
+}
+
+static void bench_tt_probe_save(int rounds) {
+    BenchTimer timer;
+    TranspositionTable tt;
+    uint64_t ops = 0;
+
+    if (tt_init(&tt, 16, 1))
+        return ;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter, ++ops) {
+                hashkey_t key = board_key_after(&boards[i], *iter) ^ (uint64_t)r;
+                bool found;
+                TTEntry *entry = tt_probe(&tt, key, &found);
+
+                if (!found)
+                    tt_save(&tt, entry, key, 0, 0, BOUND_EXACT, r & 63, *iter);
+                checksum += tt_entry_move(entry);
+            }
+    timer_report(&timer, "tt_probe_save", ops);
+    tt_destroy(&tt);
+}
+
+static void bench_tt_clear(int rounds, int threads) {
+    BenchTimer timer;
+    TranspositionTable tt;
+    uint64_t ops = 0;
+    char name[32];
+
+    if (tt_init(&tt, 256, threads))
+        return ;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r, ++ops)
+        tt_clear(&tt, threads);
+    snprintf(name, sizeof(name), "tt_clear_256mb_t%d", threads);
+    timer_report(&timer, name, ops);
+    tt_destroy(&tt);
+}
+
+static void bench_from_fen(int rounds) {
+    BenchTimer timer;
+    Board board;
+    Boardstack stack;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i, ++ops) {
+            board_from_fen(&board, &stack, CORPUS[i]);
+            checksum += board_key(&board);
+        }
+    timer_report(&timer, "from_fen", ops);
+}
+
+static void bench_to_fen(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i, ++ops)
+            checksum += (unsigned char)board_to_fen(&boards[i])[0];
+    timer_report(&timer, "to_fen", ops);
+}
+
+static void bench_move_to_san(int rounds) {
+    BenchTimer timer;
+    char san[CU_SAN_MAX_LENGTH];
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter, ++ops)
+                checksum += board_move_to_san(&boards[i], *iter, san, sizeof(san));
+    timer_report(&timer, "move_to_san", ops);
+}
+
+static void bench_san_to_move(int rounds) {
+    static char sans[CORPUS_MAX][CU_MAX_MOVES][CU_SAN_MAX_LENGTH];
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    for (size_t i = 0; i < corpusSize; ++i)
+        for (move_t *iter = mlist_begin(&moves[i]); iter < mlist_end(&moves[i]); ++iter)
+            board_move_to_san(&boards[i], *iter, sans[i][iter - mlist_begin(&moves[i])], CU_SAN_MAX_LENGTH);
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (size_t k = 0; k < mlist_size(&moves[i]); ++k, ++ops)
+                checksum += board_san_to_move(&boards[i], sans[i][k]);
+    timer_report(&timer, "san_to_move", ops);
+}
+
+static void bench_write_fen_batch(int rounds) {
+    static char buffer[CU_FEN_MAX_LENGTH * CORPUS_MAX];
+    BenchTimer timer;
+    size_t length;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r) {
+        ops += board_write_fen_batch(boards, corpusSize, buffer, sizeof(buffer), &length);
+        checksum += length;
+    }
+    timer_report(&timer, "write_fen_batch", ops);
+}
+
+static void bench_pack(int rounds) {
+    BenchTimer timer;
+    PackedBoard packed;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i, ++ops) {
+            board_pack(&packed, &boards[i]);
+            checksum += packed.data[8];
+        }
+    timer_report(&timer, "pack", ops);
+}
+
+static void bench_unpack(int rounds) {
+    static PackedBoard packed[CORPUS_MAX];
+    BenchTimer timer;
+    Board board;
+    Boardstack stack;
+    uint64_t ops = 0;
+
+    for (size_t i = 0; i < corpusSize; ++i)
+        board_pack(&packed[i], &boards[i]);
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i, ++ops) {
+            board_unpack(&board, &stack, &packed[i]);
+            checksum += board_key(&board);
+        }
+    timer_report(&timer, "unpack", ops);
+}
+
+static void bench_attackers(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i)
+            for (square_t sq = SQ_A1; sq <= SQ_H8; ++sq, ops += 2)
+                checksum += board_attackers(&boards[i], sq, WHITE) ^ board_attackers(&boards[i], sq, BLACK);
+    timer_report(&timer, "attackers", ops);
+}
+
+static void bench_slider_lookups(int rounds) {
+    BenchTimer timer;
+    uint64_t ops = 0;
+
+    timer_start(&timer);
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < corpusSize; ++i) {
+            bitboard_t occupancy = board_occupancy_bb(&boards[i]);
+
+            for (square_t sq = SQ_A1; sq <= SQ_H8; ++sq, ops += 2)
+                checksum += bishop_moves_bb(sq, occupancy) ^ rook_moves_bb(sq, occupancy);
+        }
+    timer_report(&timer, "slider_lookups", ops);
+}
+
+int main(void) {
+    cu_init();
+
+    for (corpusSize = 0; CORPUS[corpusSize] != NULL; ++corpusSize) {
+        if (board_from_fen(&boards[corpusSize], &stacks[corpusSize], CORPUS[corpusSize])) {
+            printf("Invalid corpus FEN '%s': %s\n", CORPUS[corpusSize], board_get_error(&boards[corpusSize]));
+            return 1;
+        }
+
+        mlist_generate_legal(&moves[corpusSize], &boards[corpusSize]);
+        position_from_board(&positions[corpusSize], &boards[corpusSize]);
+    }
+
+    bench_generate_legal(200000);
+    bench_generate_pseudo_legal(200000);
+    bench_move_is_pseudo_legal(50000);
+    bench_generate_has_move(5000);
+    bench_push_pop(20000);
+    bench_position_make_move(20000);
+    bench_position_generate_legal(200000);
+    bench_gives_check(50000);
+    bench_key_after(50000);
+    bench_polyglot_key(500000);
+    bench_see(50000);
+    bench_see_ge(50000);
+    bench_tt_probe_save(20000);
+    bench_tt_clear(10, 1);
+    bench_tt_clear(10, 4);
+    bench_from_fen(100000);
+    bench_to_fen(100000);
+    bench_move_to_san(20000);
+    bench_san_to_move(20000);
+    bench_write_fen_batch(100000);
+    bench_pack(100000);
+    bench_unpack(100000);
+    bench_attackers(10000);
+    bench_slider_lookups(50000);
+
+    printf("checksum %016" PRIx64 "\n", checksum);
+    return 0;
+}
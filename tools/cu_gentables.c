@@ -0,0 +1,130 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Generator for the static lookup tables of the library. It computes all the
+// tables with cu_init() and writes them on the standard output as a C source
+// file of const tables, to be compiled with "-DCU_STATIC_TABLES".
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "cu_core.h"
+
+#ifdef CU_STATIC_TABLES
+#error "The table generator must be built without CU_STATIC_TABLES"
+#endif
+
+extern bitboard_t __cu_rook_mtable[0x19000];
+extern bitboard_t __cu_bishop_mtable[0x1480];
+
+// Writes the given array of 64-bit values as a brace-enclosed initializer.
+static void print_u64_array(const uint64_t *values, size_t size, const char *indent) {
+    puts("{");
+
+    for (size_t i = 0; i < size; ++i)
+        printf("%s    0x%016" PRIX64 "%s", indent, values[i],
+            (i % 4 == 3 || i + 1 == size) ? ",\n" : ", ");
+
+    printf("%s}", indent);
+}
+
+// Writes the given array of magic entries as a brace-enclosed initializer.
+static void print_magic_array(const cu_magic_t *magics, const bitboard_t *table, const char *tableName) {
+    puts("{");
+
+    for (square_t sq = SQ_A1; sq <= SQ_H8; ++sq)
+        printf("    {0x%016" PRIX64 ", 0x%016" PRIX64 ", %s + %lu, %u},\n",
+            magics[sq].mask, magics[sq].magic, tableName,
+            (unsigned long)(magics[sq].moves - table), magics[sq].shift);
+
+    printf("}");
+}
+
+int main(void) {
+    cu_init();
+
+    puts("// This file was generated by cu_gentables, do not edit it manually.");
+    puts("");
+    puts("#include \"cu_core.h\"");
+    puts("");
+    puts("#ifndef CU_STATIC_TABLES");
+    puts("#error \"The generated tables must be built with CU_STATIC_TABLES\"");
+    puts("#endif");
+    puts("");
+
+    puts("const uint8_t __cu_square_distance[SQUARE_NB][SQUARE_NB] = {");
+    for (square_t sq1 = SQ_A1; sq1 <= SQ_H8; ++sq1) {
+        printf("    {");
+        for (square_t sq2 = SQ_A1; sq2 <= SQ_H8; ++sq2)
+            printf("%u%s", __cu_square_distance[sq1][sq2], sq2 == SQ_H8 ? "},\n" : ", ");
+    }
+    puts("};\n");
+
+    printf("const bitboard_t __cu_line_bb[SQUARE_NB][SQUARE_NB] = {\n    ");
+    for (square_t sq = SQ_A1; sq <= SQ_H8; ++sq) {
+        print_u64_array(__cu_line_bb[sq], SQUARE_NB, "    ");
+        printf(sq == SQ_H8 ? ",\n" : ",\n    ");
+    }
+    puts("};\n");
+
+    printf("const bitboard_t __cu_pseudo_moves_bb[PIECETYPE_NB][SQUARE_NB] = {\n    ");
+    for (piecetype_t pt = 0; pt < PIECETYPE_NB; ++pt) {
+        print_u64_array(__cu_pseudo_moves_bb[pt], SQUARE_NB, "    ");
+        printf(pt == PIECETYPE_NB - 1 ? ",\n" : ",\n    ");
+    }
+    puts("};\n");
+
+    printf("const bitboard_t __cu_pawn_moves_bb[COLOR_NB][SQUARE_NB] = {\n    ");
+    for (color_t c = WHITE; c <= BLACK; ++c) {
+        print_u64_array(__cu_pawn_moves_bb[c], SQUARE_NB, "    ");
+        printf(c == BLACK ? ",\n" : ",\n    ");
+    }
+    puts("};\n");
+
+    printf("static const bitboard_t __cu_rook_mtable[0x19000] = ");
+    print_u64_array(__cu_rook_mtable, 0x19000, "");
+    puts(";\n");
+
+    printf("static const bitboard_t __cu_bishop_mtable[0x1480] = ");
+    print_u64_array(__cu_bishop_mtable, 0x1480, "");
+    puts(";\n");
+
+    printf("const cu_magic_t __cu_rook_magics[SQUARE_NB] = ");
+    print_magic_array(__cu_rook_magics, __cu_rook_mtable, "__cu_rook_mtable");
+    puts(";\n");
+
+    printf("const cu_magic_t __cu_bishop_magics[SQUARE_NB] = ");
+    print_magic_array(__cu_bishop_magics, __cu_bishop_mtable, "__cu_bishop_mtable");
+    puts(";\n");
+
+    printf("const hashkey_t __cu_zobrist_psq[PIECE_NB][SQUARE_NB] = {\n    ");
+    for (piece_t pc = 0; pc < PIECE_NB; ++pc) {
+        print_u64_array(__cu_zobrist_psq[pc], SQUARE_NB, "    ");
+        printf(pc == PIECE_NB - 1 ? ",\n" : ",\n    ");
+    }
+    puts("};\n");
+
+    printf("const hashkey_t __cu_zobrist_ep[FILE_NB] = ");
+    print_u64_array(__cu_zobrist_ep, FILE_NB, "");
+    puts(";\n");
+
+    printf("const hashkey_t __cu_zobrist_castling[CASTLING_NB] = ");
+    print_u64_array(__cu_zobrist_castling, CASTLING_NB, "");
+    puts(";\n");
+
+    printf("const hashkey_t __cu_zobrist_turn = 0x%016" PRIX64 ";\n", __cu_zobrist_turn);
+
+    return 0;
+}
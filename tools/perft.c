@@ -0,0 +1,99 @@
+// Libchessutil, a library for chess utilities in C/C++
+// Copyright (C) 2021 Morgan Houppin
+//
+// Libchessutil is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Libchessutil is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Command-line perft tool. Usage: perft <depth> [threads] [fen] [cache MB]
+// The thread count defaults to the number of online processors, the position
+// to the starting one, and the cache size to 256 MB (0 disables the cache).
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "cu_perft.h"
+
+static uint64_t get_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Parses the whole argument as a decimal integer between min and max, and
+// stores it in value. Returns 0 if successful, a non-null value otherwise.
+static int parse_int_arg(const char *arg, long min, long max, long *value) {
+    char *end;
+
+    errno = 0;
+    *value = strtol(arg, &end, 10);
+
+    return errno || end == arg || *end != '\0' || *value < min || *value > max;
+}
+
+int main(int argc, char **argv) {
+    long depth, threads = sysconf(_SC_NPROCESSORS_ONLN), cacheSize = 256;
+    const char *fen = argc > 3 ? argv[3] : STARTING_FEN;
+
+    if (argc < 2 || argc > 5
+        || parse_int_arg(argv[1], 1, INT_MAX, &depth)
+        || (argc > 2 && parse_int_arg(argv[2], 1, INT_MAX, &threads))
+        || (argc > 4 && parse_int_arg(argv[4], 0, LONG_MAX, &cacheSize))) {
+        fprintf(stderr, "Usage: %s <depth> [threads] [fen] [cache MB]\n", argv[0]);
+        return 1;
+    }
+
+    if (threads < 1)
+        threads = 1;
+
+    cu_init();
+
+    Board board;
+    Boardstack stack;
+    PerftCache cache;
+    uint64_t nodes;
+
+    if (board_from_fen(&board, &stack, fen)) {
+        fprintf(stderr, "Invalid FEN: %s\n", board_get_error(&board));
+        return 1;
+    }
+
+    if (cacheSize && perft_cache_init(&cache, (size_t)cacheSize)) {
+        fputs("Out of memory\n", stderr);
+        return 1;
+    }
+
+    uint64_t start = get_time_ms();
+
+    if (cu_perft(&nodes, &board, (int)depth, (int)threads, NULL, cacheSize ? &cache : NULL)) {
+        fputs("Out of memory\n", stderr);
+        return 1;
+    }
+
+    uint64_t elapsed = get_time_ms() - start;
+    uint64_t nps = (nodes * 1000) / (elapsed + !elapsed);
+
+    printf("Nodes:   %" PRIu64 "\n", nodes);
+    printf("Threads: %ld\n", threads);
+    printf("Time:    %" PRIu64 ".%03" PRIu64 " seconds\n", elapsed / 1000, elapsed % 1000);
+    printf("Speed:   %" PRIu64 ".%03" PRIu64 " Mnps\n", nps / 1000000, (nps / 1000) % 1000);
+
+    if (cacheSize)
+        perft_cache_destroy(&cache);
+
+    board_destroy(&board);
+    return 0;
+}